@@ -114,7 +114,7 @@ cJSON *ktv_obj_to_json_object(ktv_obj *obj)
     for (size_t i = 0; i < field_count; i++)
     {
         ktv_field *field = model->fields[i];
-        void *value = obj->values[i];
+        void *value = ktv_obj_get_value_by_index(obj, i);
         if (value == NULL)
         {
             continue;
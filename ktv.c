@@ -2,27 +2,112 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "ktv.h"
 
 #define INDEX_INVALID 255
+#define KTV_MASK_BYTES 32 // one bit per field, up to 256 fields per model
+#define KTV_MASK_TEST(bits, i) (((bits)[(i) / 8] >> ((i) % 8)) & 1)
+#define KTV_ARENA_ALIGN sizeof(void *)
 
-uint8_t ktv_find_field_index(ktv_obj *obj, const char *alias, uint8_t type)
+// storage of the calling thread's ktv_pool, without thread local support one pool serves the whole process
+#ifndef KTV_THREAD_LOCAL
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define KTV_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define KTV_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define KTV_THREAD_LOCAL __declspec(thread)
+#else
+#define KTV_THREAD_LOCAL
+#endif
+#endif
+
+#if !defined(KTV_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KTV_SIMD_X86
+#include <immintrin.h>
+#elif !defined(KTV_NO_SIMD) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#define KTV_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * FNV-1a hash of a model name or field alias
+ */
+uint32_t ktv_hash(const char *key)
 {
-    ktv_tree *tree = obj->tree;
-    ktv_model *model = tree->models[obj->model_index];
-    if (model == NULL)
+    uint32_t hash = 2166136261u;
+    for (; *key != '\0'; key++)
     {
-        return INDEX_INVALID;
+        hash ^= (uint8_t)*key;
+        hash *= 16777619u;
     }
-    for (size_t i = 0; i < model->field_count; i++)
+    return hash;
+}
+
+/**
+ * empty open addressing table for count keys, at most half full so probe sequences stay short
+ */
+uint8_t *ktv_hash_table_new(size_t count, uint16_t *mask)
+{
+    size_t size = 2;
+    while (size < count * 2)
     {
-        ktv_field *field = model->fields[i];
-        if (strcmp(field->alias, alias) == 0 && field->type == type)
+        size *= 2;
+    }
+    uint8_t *table = malloc(size);
+    memset(table, INDEX_INVALID, size);
+    *mask = size - 1;
+    return table;
+}
+
+void ktv_hash_table_insert(uint8_t *table, uint16_t mask, const char *key, uint8_t index)
+{
+    size_t slot = ktv_hash(key) & mask;
+    while (table[slot] != INDEX_INVALID)
+    {
+        slot = (slot + 1) & mask;
+    }
+    table[slot] = index;
+}
+
+/**
+ * field index of alias by hash lookup, type 0 matches any field type
+ */
+uint8_t ktv_model_alias_index(ktv_model *model, const char *alias, uint8_t type)
+{
+    for (size_t slot = ktv_hash(alias) & model->alias_mask;; slot = (slot + 1) & model->alias_mask)
+    {
+        uint8_t index = model->alias_table[slot];
+        if (index == INDEX_INVALID)
         {
-            return i;
+            return INDEX_INVALID;
         }
+        ktv_field *field = model->fields[index];
+        if (strcmp(field->alias, alias) == 0 && (type == 0 || field->type == type))
+        {
+            return index;
+        }
+    }
+}
+
+uint8_t ktv_find_model_field_index(ktv_model *model, const char *alias, uint8_t type)
+{
+    if (model == NULL)
+    {
+        return INDEX_INVALID;
     }
-    return INDEX_INVALID;
+    return ktv_model_alias_index(model, alias, type);
+}
+
+uint8_t ktv_find_field_index(ktv_obj *obj, const char *alias, uint8_t type)
+{
+    return ktv_find_model_field_index(obj->tree->models[obj->model_index], alias, type);
+}
+
+uint8_t ktv_obj_field_index(ktv_obj *obj, const char *alias)
+{
+    return ktv_model_alias_index(obj->tree->models[obj->model_index], alias, 0);
 }
 
 uint8_t ktv_find_model_index(ktv_tree *tree, const char *name)
@@ -31,14 +116,14 @@ uint8_t ktv_find_model_index(ktv_tree *tree, const char *name)
     {
         return INDEX_INVALID;
     }
-    for (size_t i = 0; i < tree->model_count; i++)
+    for (size_t slot = ktv_hash(name) & tree->name_mask;; slot = (slot + 1) & tree->name_mask)
     {
-        if (strcmp(tree->models[i]->name, name) == 0)
+        uint8_t index = tree->name_table[slot];
+        if (index == INDEX_INVALID || strcmp(tree->models[index]->name, name) == 0)
         {
-            return i;
+            return index;
         }
     }
-    return INDEX_INVALID;
 }
 
 int16_t ktv_bytes_to_int2(uint8_t *buffer)
@@ -50,671 +135,3468 @@ int16_t ktv_bytes_to_int2(uint8_t *buffer)
 
 int32_t ktv_bytes_to_int4(uint8_t *buffer)
 {
-    int32_t value = (int32_t)buffer[0] << 24 |
-                    (int32_t)buffer[1] << 16 |
-                    (int32_t)buffer[2] << 8 |
-                    (int32_t)buffer[3] << 0;
+    int32_t value = (uint32_t)buffer[0] << 24 |
+                    (uint32_t)buffer[1] << 16 |
+                    (uint32_t)buffer[2] << 8 |
+                    (uint32_t)buffer[3] << 0;
     return value;
 }
 
-void *ktv_obj_get_value_ptr(ktv_obj *obj, const char *alias, uint8_t type)
+void ktv_int2_to_bytes(int16_t value, uint8_t *buffer)
 {
-    uint8_t field_index = ktv_find_field_index(obj, alias, type);
-    if (field_index == INDEX_INVALID || obj->values[field_index] == NULL)
+    buffer[0] = value >> 8;
+    buffer[1] = value >> 0;
+}
+
+void ktv_int4_to_bytes(int32_t value, uint8_t *buffer)
+{
+    buffer[0] = value >> 24;
+    buffer[1] = value >> 16;
+    buffer[2] = value >> 8;
+    buffer[3] = value >> 0;
+}
+
+size_t ktv_type_size(uint8_t type)
+{
+    switch (type)
     {
-        return NULL;
+    case KTV_TCHAR:
+    case KTV_TBYTE:
+        return 1;
+    case KTV_TINT2:
+        return 2;
+    case KTV_TINT4:
+        return 4;
+    default:
+        return 0;
     }
-    return obj->values[field_index];
 }
 
-void *ktv_obj_malloc_value_ptr(ktv_obj *obj, const char *alias, uint8_t type, size_t size)
+/**
+ * bulk big endian <-> host conversion of int2 / int4 arrays
+ * on little endian hosts both directions are a plain byte swap, done by a SIMD kernel
+ * picked once at runtime (AVX2 / SSSE3 / NEON), everything else uses the scalar loops
+ * define KTV_NO_SIMD to always use the scalar loops
+ */
+typedef void (*ktv_swap_kernel)(const uint8_t *src, uint8_t *dst, size_t count);
+
+void ktv_swap2_scalar(const uint8_t *src, uint8_t *dst, size_t count)
 {
-    uint8_t field_index = ktv_find_field_index(obj, alias, type);
-    if (field_index == INDEX_INVALID)
+    for (size_t i = 0; i < count; i++, src += 2, dst += 2)
     {
-        return NULL;
+        uint8_t b0 = src[0];
+        dst[0] = src[1];
+        dst[1] = b0;
     }
-    if (obj->values[field_index] == NULL)
+}
+
+void ktv_swap4_scalar(const uint8_t *src, uint8_t *dst, size_t count)
+{
+    for (size_t i = 0; i < count; i++, src += 4, dst += 4)
     {
-        obj->values[field_index] = malloc(size);
+        uint8_t b0 = src[0];
+        uint8_t b1 = src[1];
+        dst[0] = src[3];
+        dst[1] = src[2];
+        dst[2] = b1;
+        dst[3] = b0;
     }
-    return obj->values[field_index];
 }
 
-ktv_array *ktv_array_new_basic(ktv_obj *obj, const char *alias, uint16_t count)
+#if defined(KTV_SIMD_X86)
+__attribute__((target("ssse3"))) void ktv_swap2_ssse3(const uint8_t *src, uint8_t *dst, size_t count)
 {
-    uint8_t field_index = ktv_find_field_index(obj, alias, KTV_TARRAY);
-    if (field_index == INDEX_INVALID)
+    const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
     {
-        return NULL;
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_shuffle_epi8(v, mask));
     }
-    ktv_field *field = obj->tree->models[obj->model_index]->fields[field_index];
-    ktv_array *array = malloc(sizeof(ktv_array));
-    array->type = field->type;
-    array->sub_type = field->sub_type;
-    array->objects = NULL;
-    array->values = NULL;
-    array->count = count;
-    return array;
+    ktv_swap2_scalar(src + i * 2, dst + i * 2, count - i);
 }
 
-void ktv_buffer_append(ktv_buffer *buffer, uint8_t *data, size_t size)
+__attribute__((target("ssse3"))) void ktv_swap4_ssse3(const uint8_t *src, uint8_t *dst, size_t count)
 {
-    if (buffer->size == 0)
+    const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
     {
-        buffer->buffer = malloc(sizeof(uint8_t) * size);
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_shuffle_epi8(v, mask));
     }
-    else
+    ktv_swap4_scalar(src + i * 4, dst + i * 4, count - i);
+}
+
+__attribute__((target("avx2"))) void ktv_swap2_avx2(const uint8_t *src, uint8_t *dst, size_t count)
+{
+    const __m256i mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
     {
-        buffer->buffer = realloc(buffer->buffer, buffer->size + size);
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i * 2));
+        _mm256_storeu_si256((__m256i *)(dst + i * 2), _mm256_shuffle_epi8(v, mask));
     }
-    memcpy(buffer->buffer + buffer->size, data, size);
-    buffer->size = buffer->size + size;
+    ktv_swap2_scalar(src + i * 2, dst + i * 2, count - i);
 }
 
-ktv_tree *ktv_tree_new(uint8_t *parsed_proto, size_t size)
+__attribute__((target("avx2"))) void ktv_swap4_avx2(const uint8_t *src, uint8_t *dst, size_t count)
 {
-    ktv_tree *tree = malloc(sizeof(ktv_tree));
-    // parse model count
-    uint8_t model_count = parsed_proto[0];
-    tree->model_count = model_count;
-    tree->models = malloc(sizeof(ktv_model *) * model_count);
-    size_t index = 1;
-    uint8_t model_index = 0;
-    do
+    const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
     {
-        ktv_model *model = malloc(sizeof(ktv_model));
-        // parse model name length
-        size_t name_length = parsed_proto[index];
-        index += 1;
-        // parse model name
-        char *name = malloc((name_length + 1) * sizeof(char));
-        memcpy(name, parsed_proto + index, name_length);
-        name[name_length] = '\0';
-        model->name = name;
-        index += name_length;
-        // parse field count
-        size_t field_count = parsed_proto[index];
-        model->field_count = field_count;
-        index += 1;
-        // parse fields
-        ktv_field **fields = malloc(sizeof(ktv_field *) * field_count);
-        model->fields = fields;
-        size_t field_index = 0;
-        do
-        {
-            ktv_field *field = malloc(sizeof(ktv_field));
-            // parse field alias length
-            size_t alias_length = parsed_proto[index];
-            index += 1;
-            // parse field alias
-            char *alias = malloc((alias_length + 1) * sizeof(char));
-            memcpy(alias, parsed_proto + index, alias_length);
-            alias[alias_length] = '\0';
-            index += alias_length;
-            // parse field type
-            field->alias = alias;
-            field->type = parsed_proto[index];
-            index += 1;
-            field->sub_type = parsed_proto[index];
-            index += 1;
-            fields[field_index] = field;
-            field_index++;
-        } while (field_index < field_count);
-        tree->models[model_index] = model;
-        model_index++;
-    } while (index < size);
-    return tree;
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+        _mm256_storeu_si256((__m256i *)(dst + i * 4), _mm256_shuffle_epi8(v, mask));
+    }
+    ktv_swap4_scalar(src + i * 4, dst + i * 4, count - i);
+}
+#elif defined(KTV_SIMD_NEON)
+void ktv_swap2_neon(const uint8_t *src, uint8_t *dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        vst1q_u8(dst + i * 2, vrev16q_u8(vld1q_u8(src + i * 2)));
+    }
+    ktv_swap2_scalar(src + i * 2, dst + i * 2, count - i);
 }
 
-void ktv_tree_delete(ktv_tree *tree)
+void ktv_swap4_neon(const uint8_t *src, uint8_t *dst, size_t count)
 {
-    if (tree == NULL)
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
     {
-        return;
+        vst1q_u8(dst + i * 4, vrev32q_u8(vld1q_u8(src + i * 4)));
     }
-    for (size_t i = 0; i < tree->model_count; i++)
+    ktv_swap4_scalar(src + i * 4, dst + i * 4, count - i);
+}
+#endif
+
+// kernels picked for this cpu, NULL if only the scalar loop applies
+ktv_swap_kernel ktv_swap2_simd = NULL;
+ktv_swap_kernel ktv_swap4_simd = NULL;
+// kernels in use, the picked ones unless ktv_set_scalar_kernels forced the scalar loop
+ktv_swap_kernel ktv_swap2_kernel = NULL;
+ktv_swap_kernel ktv_swap4_kernel = NULL;
+pthread_once_t ktv_swap_kernel_once = PTHREAD_ONCE_INIT;
+
+void ktv_pick_swap_kernels(void)
+{
+    uint16_t probe = 1;
+    if (*(uint8_t *)&probe == 1)
     {
-        ktv_model *model = tree->models[i];
-        for (size_t j = 0; j < model->field_count; j++)
+#if defined(KTV_SIMD_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
         {
-            ktv_field *field = model->fields[j];
-            free(field->alias);
-            free(field);
+            ktv_swap2_simd = ktv_swap2_avx2;
+            ktv_swap4_simd = ktv_swap4_avx2;
         }
-        free(model->name);
-        free(model->fields);
-        free(model);
+        else if (__builtin_cpu_supports("ssse3"))
+        {
+            ktv_swap2_simd = ktv_swap2_ssse3;
+            ktv_swap4_simd = ktv_swap4_ssse3;
+        }
+#elif defined(KTV_SIMD_NEON)
+        ktv_swap2_simd = ktv_swap2_neon;
+        ktv_swap4_simd = ktv_swap4_neon;
+#endif
     }
-    free(tree->models);
-    free(tree);
+    ktv_swap2_kernel = ktv_swap2_simd;
+    ktv_swap4_kernel = ktv_swap4_simd;
 }
 
-ktv_obj *ktv_obj_new(ktv_tree *tree, const char *name)
+/**
+ * pick the swap kernels for this cpu exactly once, called from ktv_tree_new so the kernels are fixed
+ * before any array is converted, parallel workers only ever read them
+ */
+void ktv_select_swap_kernels(void)
 {
-    uint8_t index = ktv_find_model_index(tree, name);
-    if (index == INDEX_INVALID)
+    pthread_once(&ktv_swap_kernel_once, ktv_pick_swap_kernels);
+}
+
+void ktv_set_scalar_kernels(int scalar)
+{
+    ktv_select_swap_kernels();
+    ktv_swap2_kernel = scalar ? NULL : ktv_swap2_simd;
+    ktv_swap4_kernel = scalar ? NULL : ktv_swap4_simd;
+}
+
+void ktv_bytes_to_int2s(const uint8_t *buffer, int16_t *values, size_t count)
+{
+    if (ktv_swap2_kernel != NULL)
     {
-        return NULL;
+        ktv_swap2_kernel(buffer, (uint8_t *)values, count);
+        return;
     }
-    ktv_model *model = tree->models[index];
-    ktv_obj *obj = malloc(sizeof(ktv_obj));
-    obj->tree = tree;
-    obj->model_index = index;
-    void **values = malloc(sizeof(void *) * model->field_count);
-    for (size_t i = 0; i < model->field_count; i++)
+    for (size_t i = 0; i < count; i++)
     {
-        values[i] = NULL;
+        values[i] = ktv_bytes_to_int2((uint8_t *)buffer + i * 2);
     }
-    obj->values = values;
-    return obj;
 }
 
-void ktv_obj_delete(ktv_obj *obj)
+void ktv_bytes_to_int4s(const uint8_t *buffer, int32_t *values, size_t count)
 {
-    if (obj == NULL)
+    if (ktv_swap4_kernel != NULL)
     {
+        ktv_swap4_kernel(buffer, (uint8_t *)values, count);
         return;
     }
-    ktv_model *model = obj->tree->models[obj->model_index];
-    for (size_t i = 0; i < model->field_count; i++)
+    for (size_t i = 0; i < count; i++)
     {
-        void *value = obj->values[i];
-        ktv_field *field = model->fields[i];
-        if (value != NULL)
-        {
-            if (field->type == KTV_TMODEL)
-            {
-                ktv_obj_delete((ktv_obj *)value);
-                obj->values[i] = NULL;
-            }
-            else if (field->type == KTV_TARRAY || field->type == KTV_TMODEL_ARRAY)
-            {
-                ktv_array_delete((ktv_array *)value);
-                obj->values[i] = NULL;
-            }
-            else
-            {
-                free(value);
-            }
-        }
+        values[i] = ktv_bytes_to_int4((uint8_t *)buffer + i * 4);
     }
-    free(obj->values);
-    free(obj);
 }
 
-void ktv_obj_set_char(ktv_obj *obj, const char *alias, char new_value)
+void ktv_int2s_to_bytes(const int16_t *values, uint8_t *buffer, size_t count)
 {
-    void *value = ktv_obj_malloc_value_ptr(obj, alias, KTV_TCHAR, sizeof(char));
-    *(char *)value = new_value;
+    if (ktv_swap2_kernel != NULL)
+    {
+        ktv_swap2_kernel((const uint8_t *)values, buffer, count);
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        ktv_int2_to_bytes(values[i], buffer + i * 2);
+    }
 }
 
-char ktv_obj_get_char(ktv_obj *obj, const char *alias)
+void ktv_int4s_to_bytes(const int32_t *values, uint8_t *buffer, size_t count)
 {
-    void *value = ktv_obj_get_value_ptr(obj, alias, KTV_TCHAR);
-    return value != NULL ? *(char *)value : 0;
+    if (ktv_swap4_kernel != NULL)
+    {
+        ktv_swap4_kernel((const uint8_t *)values, buffer, count);
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        ktv_int4_to_bytes(values[i], buffer + i * 4);
+    }
 }
 
-void ktv_obj_set_byte(ktv_obj *obj, const char *alias, int8_t new_value)
+ktv_arena *ktv_arena_new(size_t chunk_size)
 {
-    void *value = ktv_obj_malloc_value_ptr(obj, alias, KTV_TBYTE, sizeof(int8_t));
-    *(int8_t *)value = new_value;
+    ktv_arena *arena = malloc(sizeof(ktv_arena));
+    arena->chunk_size = chunk_size > 0 ? chunk_size : KTV_ARENA_CHUNK_SIZE;
+    arena->chunk = NULL;
+    return arena;
 }
 
-int8_t ktv_obj_get_byte(ktv_obj *obj, const char *alias)
+ktv_arena_chunk *ktv_arena_chunk_new(ktv_arena_chunk *next, size_t size)
 {
-    void *value = ktv_obj_get_value_ptr(obj, alias, KTV_TBYTE);
-    return value != NULL ? *(int8_t *)value : 0;
+    ktv_arena_chunk *chunk = malloc(sizeof(ktv_arena_chunk) + size);
+    chunk->next = next;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
 }
 
-void ktv_obj_set_int2(ktv_obj *obj, const char *alias, int16_t new_value)
+void *ktv_arena_alloc(ktv_arena *arena, size_t size)
 {
-    void *value = ktv_obj_malloc_value_ptr(obj, alias, KTV_TINT2, sizeof(int16_t));
-    *(int16_t *)value = new_value;
+    size = (size + KTV_ARENA_ALIGN - 1) & ~(size_t)(KTV_ARENA_ALIGN - 1);
+    ktv_arena_chunk *chunk = arena->chunk;
+    if (chunk == NULL || chunk->size - chunk->used < size)
+    {
+        chunk = ktv_arena_chunk_new(chunk, size > arena->chunk_size ? size : arena->chunk_size);
+        arena->chunk = chunk;
+    }
+    void *memory = chunk->data + chunk->used;
+    chunk->used += size;
+    return memory;
 }
 
-int16_t ktv_obj_get_int2(ktv_obj *obj, const char *alias)
+void ktv_arena_reset(ktv_arena *arena)
 {
-    void *value = ktv_obj_get_value_ptr(obj, alias, KTV_TINT2);
-    return value != NULL ? *(int16_t *)value : 0;
+    ktv_arena_chunk *chunk = arena->chunk;
+    if (chunk == NULL)
+    {
+        return;
+    }
+    if (chunk->next == NULL)
+    {
+        chunk->used = 0;
+        return;
+    }
+    // merge the chain into one chunk, so a request of the same size fits without chaining next time
+    size_t size = 0;
+    while (chunk != NULL)
+    {
+        ktv_arena_chunk *next = chunk->next;
+        size += chunk->size;
+        free(chunk);
+        chunk = next;
+    }
+    arena->chunk = ktv_arena_chunk_new(NULL, size);
 }
 
-void ktv_obj_set_int4(ktv_obj *obj, const char *alias, int32_t new_value)
+void ktv_arena_delete(ktv_arena *arena)
 {
-    void *value = ktv_obj_malloc_value_ptr(obj, alias, KTV_TINT4, sizeof(int32_t));
-    *(int32_t *)value = new_value;
+    if (arena == NULL)
+    {
+        return;
+    }
+    ktv_arena_chunk *chunk = arena->chunk;
+    while (chunk != NULL)
+    {
+        ktv_arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
 }
 
-int32_t ktv_obj_get_int4(ktv_obj *obj, const char *alias)
+/**
+ * memory of an object graph node, from arena if any
+ */
+void *ktv_obj_alloc(ktv_arena *arena, size_t size)
 {
-    void *value = ktv_obj_get_value_ptr(obj, alias, KTV_TINT4);
-    return value != NULL ? *(int32_t *)value : 0;
+    return arena != NULL ? ktv_arena_alloc(arena, size) : malloc(size);
 }
 
-void ktv_obj_set_obj(ktv_obj *obj, const char *alias, ktv_obj *value)
+KTV_THREAD_LOCAL ktv_pool *ktv_pool_local = NULL;
+
+ktv_pool *ktv_pool_new(ktv_tree *tree, size_t cap)
 {
-    uint8_t field_index = ktv_find_field_index(obj, alias, KTV_TMODEL);
-    if (field_index == INDEX_INVALID)
+    ktv_pool *pool = malloc(sizeof(ktv_pool));
+    pool->tree = tree;
+    pool->objs = calloc(tree->model_count > 0 ? tree->model_count : 1, sizeof(ktv_obj *));
+    pool->obj_counts = calloc(tree->model_count > 0 ? tree->model_count : 1, sizeof(size_t));
+    pool->arrays = NULL;
+    pool->array_count = 0;
+    pool->cap = cap > 0 ? cap : KTV_POOL_CAP;
+    pool->hits = 0;
+    pool->misses = 0;
+    pool->attached = 0;
+    return pool;
+}
+
+void ktv_pool_attach(ktv_pool *pool)
+{
+    if (ktv_pool_local != NULL)
     {
-        return;
+        ktv_pool_local->attached--;
     }
-    // todo: delete replaced obj?
-    obj->values[field_index] = value;
+    if (pool != NULL)
+    {
+        pool->attached++;
+    }
+    ktv_pool_local = pool;
+}
+
+ktv_pool *ktv_pool_current(void)
+{
+    return ktv_pool_local;
+}
+
+int ktv_pool_delete(ktv_pool *pool)
+{
+    if (pool == NULL)
+    {
+        return 0;
+    }
+    if (ktv_pool_local == pool)
+    {
+        ktv_pool_attach(NULL);
+    }
+    // freeing it now would leave the other threads' attachment dangling
+    if (pool->attached > 0)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < pool->tree->model_count; i++)
+    {
+        ktv_obj *obj = pool->objs[i];
+        while (obj != NULL)
+        {
+            ktv_obj *next = *(ktv_obj **)obj;
+            free(obj);
+            obj = next;
+        }
+    }
+    ktv_array *array = pool->arrays;
+    while (array != NULL)
+    {
+        ktv_array *next = *(ktv_array **)array;
+        free(array);
+        array = next;
+    }
+    free(pool->objs);
+    free(pool->obj_counts);
+    free(pool);
+    return 0;
+}
+
+/**
+ * heap memory of an object shell, from the calling thread's pool if it caches one of this model
+ */
+ktv_obj *ktv_pool_obj_take(ktv_tree *tree, uint8_t index, size_t size)
+{
+    ktv_pool *pool = ktv_pool_local;
+    if (pool == NULL || pool->tree != tree)
+    {
+        return malloc(size);
+    }
+    ktv_obj *obj = pool->objs[index];
+    if (obj == NULL)
+    {
+        pool->misses++;
+        return malloc(size);
+    }
+    pool->objs[index] = *(ktv_obj **)obj;
+    pool->obj_counts[index]--;
+    pool->hits++;
+    return obj;
+}
+
+/**
+ * release a heap object shell into the calling thread's pool, or free it once the pool is full
+ */
+void ktv_pool_obj_give(ktv_obj *obj)
+{
+    ktv_pool *pool = ktv_pool_local;
+    uint8_t index = obj->model_index;
+    if (pool == NULL || pool->tree != obj->tree || pool->obj_counts[index] >= pool->cap)
+    {
+        free(obj);
+        return;
+    }
+    *(ktv_obj **)obj = pool->objs[index];
+    pool->objs[index] = obj;
+    pool->obj_counts[index]++;
+}
+
+ktv_array *ktv_pool_array_take(void)
+{
+    ktv_pool *pool = ktv_pool_local;
+    if (pool == NULL)
+    {
+        return malloc(sizeof(ktv_array));
+    }
+    ktv_array *array = pool->arrays;
+    if (array == NULL)
+    {
+        pool->misses++;
+        return malloc(sizeof(ktv_array));
+    }
+    pool->arrays = *(ktv_array **)array;
+    pool->array_count--;
+    pool->hits++;
+    return array;
+}
+
+void ktv_pool_array_give(ktv_array *array)
+{
+    ktv_pool *pool = ktv_pool_local;
+    if (pool == NULL || pool->array_count >= pool->cap)
+    {
+        free(array);
+        return;
+    }
+    *(ktv_array **)array = pool->arrays;
+    pool->arrays = array;
+    pool->array_count++;
+}
+
+/**
+ * pointer slot of an array / model field, the next slot keeps storage parked by ktv_obj_reset
+ */
+void **ktv_obj_slot(ktv_obj *obj, uint8_t field_index)
+{
+    return (void **)(obj->data + obj->tree->models[obj->model_index]->offsets[field_index]);
+}
+
+void *ktv_obj_get_value_by_index(ktv_obj *obj, uint8_t field_index)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    if (field_index >= model->field_count)
+    {
+        return NULL;
+    }
+    if (ktv_type_size(model->fields[field_index]->type) == 0)
+    {
+        return *ktv_obj_slot(obj, field_index);
+    }
+    return KTV_MASK_TEST(obj->data, field_index) ? obj->data + model->offsets[field_index] : NULL;
+}
+
+void *ktv_obj_get_value_ptr(ktv_obj *obj, const char *alias, uint8_t type)
+{
+    uint8_t field_index = ktv_find_field_index(obj, alias, type);
+    if (field_index == INDEX_INVALID)
+    {
+        return NULL;
+    }
+    return ktv_obj_get_value_by_index(obj, field_index);
+}
+
+/**
+ * inline slot of a scalar field, marked present
+ */
+void *ktv_obj_scalar_slot(ktv_obj *obj, uint8_t field_index, uint8_t type)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    if (field_index >= model->field_count || model->fields[field_index]->type != type)
+    {
+        return NULL;
+    }
+    obj->data[field_index / 8] |= 1 << (field_index % 8);
+    return obj->data + model->offsets[field_index];
+}
+
+ktv_array *ktv_array_new_basic_index(ktv_obj *obj, uint8_t field_index, uint16_t count)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    if (field_index >= model->field_count || model->fields[field_index]->type != KTV_TARRAY)
+    {
+        return NULL;
+    }
+    ktv_field *field = model->fields[field_index];
+    ktv_array *array = obj->arena != NULL ? ktv_arena_alloc(obj->arena, sizeof(ktv_array)) : ktv_pool_array_take();
+    array->arena = obj->arena;
+    array->type = field->type;
+    array->sub_type = field->sub_type;
+    array->objects = NULL;
+    array->values = NULL;
+    array->count = count;
+    array->capacity = count;
+    return array;
+}
+
+ktv_array *ktv_array_new_basic(ktv_obj *obj, const char *alias, uint16_t count)
+{
+    return ktv_array_new_basic_index(obj, ktv_find_field_index(obj, alias, KTV_TARRAY), count);
+}
+
+/**
+ * compile model fields into a codec program:
+ * consecutive scalar fields are merged into one block op with precomputed wire size,
+ * every other field becomes one op carrying its element size or model index,
+ * each scalar also gets its (slot offset, width) copy entry, so the model must be laid out first
+ */
+void ktv_model_compile(ktv_model *model)
+{
+    model->ops = malloc(sizeof(ktv_op) * model->field_count);
+    model->scalars = calloc(model->field_count > 0 ? model->field_count : 1, sizeof(ktv_scalar_op));
+    model->op_count = 0;
+    model->fixed_size = 0;
+    ktv_op *block = NULL;
+    for (size_t i = 0; i < model->field_count; i++)
+    {
+        ktv_field *field = model->fields[i];
+        size_t scalar_size = ktv_type_size(field->type);
+        model->scalars[i].offset = model->offsets[i];
+        model->scalars[i].width = scalar_size;
+        if (scalar_size > 0 && block != NULL)
+        {
+            block->field_count++;
+            block->size += scalar_size;
+            model->fixed_size += scalar_size;
+            continue;
+        }
+        ktv_op *op = &model->ops[model->op_count++];
+        op->field_index = i;
+        op->field_count = 1;
+        op->sub_type = field->sub_type;
+        if (scalar_size > 0)
+        {
+            op->code = KTV_OP_BLOCK;
+            op->size = scalar_size;
+            model->fixed_size += scalar_size;
+            block = op;
+            continue;
+        }
+        op->code = field->type == KTV_TARRAY ? KTV_OP_ARRAY : field->type == KTV_TMODEL ? KTV_OP_MODEL : KTV_OP_MODEL_ARRAY;
+        op->size = field->type == KTV_TARRAY ? ktv_type_size(field->sub_type) : 0;
+        model->fixed_size += 2;
+        block = NULL;
+    }
+}
+
+/**
+ * lay out object data of a model: presence bitmap, then pointer slots (value + parked value by
+ * ktv_obj_reset) for arrays & models, then scalars by descending size, so every slot is naturally aligned
+ */
+void ktv_model_layout(ktv_model *model)
+{
+    model->offsets = malloc(sizeof(uint16_t) * (model->field_count > 0 ? model->field_count : 1));
+    size_t offset = (model->field_count + 7) / 8;
+    offset = (offset + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+    for (size_t i = 0; i < model->field_count; i++)
+    {
+        if (ktv_type_size(model->fields[i]->type) == 0)
+        {
+            model->offsets[i] = offset;
+            offset += sizeof(void *) * 2;
+        }
+    }
+    for (size_t slot_size = 4; slot_size > 0; slot_size /= 2)
+    {
+        for (size_t i = 0; i < model->field_count; i++)
+        {
+            if (ktv_type_size(model->fields[i]->type) == slot_size)
+            {
+                model->offsets[i] = offset;
+                offset += slot_size;
+            }
+        }
+    }
+    model->data_size = (offset + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+}
+
+ktv_tree *ktv_tree_new(uint8_t *parsed_proto, size_t size)
+{
+    ktv_select_swap_kernels();
+    ktv_tree *tree = malloc(sizeof(ktv_tree));
+    // parse model count
+    uint8_t model_count = parsed_proto[0];
+    tree->model_count = model_count;
+    tree->models = malloc(sizeof(ktv_model *) * model_count);
+    size_t index = 1;
+    uint8_t model_index = 0;
+    do
+    {
+        ktv_model *model = malloc(sizeof(ktv_model));
+        // parse model name length
+        size_t name_length = parsed_proto[index];
+        index += 1;
+        // parse model name
+        char *name = malloc((name_length + 1) * sizeof(char));
+        memcpy(name, parsed_proto + index, name_length);
+        name[name_length] = '\0';
+        model->name = name;
+        index += name_length;
+        // parse field count
+        size_t field_count = parsed_proto[index];
+        model->field_count = field_count;
+        index += 1;
+        // parse fields
+        ktv_field **fields = malloc(sizeof(ktv_field *) * field_count);
+        model->fields = fields;
+        size_t field_index = 0;
+        do
+        {
+            ktv_field *field = malloc(sizeof(ktv_field));
+            // parse field alias length
+            size_t alias_length = parsed_proto[index];
+            index += 1;
+            // parse field alias
+            char *alias = malloc((alias_length + 1) * sizeof(char));
+            memcpy(alias, parsed_proto + index, alias_length);
+            alias[alias_length] = '\0';
+            index += alias_length;
+            // parse field type
+            field->alias = alias;
+            field->type = parsed_proto[index];
+            index += 1;
+            field->sub_type = parsed_proto[index];
+            index += 1;
+            fields[field_index] = field;
+            field_index++;
+        } while (field_index < field_count);
+        ktv_model_layout(model);
+        ktv_model_compile(model);
+        model->alias_table = ktv_hash_table_new(field_count, &model->alias_mask);
+        for (size_t i = 0; i < field_count; i++)
+        {
+            ktv_hash_table_insert(model->alias_table, model->alias_mask, fields[i]->alias, i);
+        }
+        tree->models[model_index] = model;
+        model_index++;
+    } while (index < size);
+    tree->name_table = ktv_hash_table_new(model_count, &tree->name_mask);
+    for (size_t i = 0; i < model_count; i++)
+    {
+        ktv_hash_table_insert(tree->name_table, tree->name_mask, tree->models[i]->name, i);
+    }
+    return tree;
+}
+
+void ktv_tree_delete(ktv_tree *tree)
+{
+    if (tree == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < tree->model_count; i++)
+    {
+        ktv_model *model = tree->models[i];
+        for (size_t j = 0; j < model->field_count; j++)
+        {
+            ktv_field *field = model->fields[j];
+            free(field->alias);
+            free(field);
+        }
+        free(model->name);
+        free(model->fields);
+        free(model->ops);
+        free(model->scalars);
+        free(model->offsets);
+        free(model->alias_table);
+        free(model);
+    }
+    free(tree->models);
+    free(tree->name_table);
+    free(tree);
+}
+
+ktv_obj *ktv_obj_new_index(ktv_tree *tree, ktv_arena *arena, uint8_t index);
+void ktv_obj_release_value(ktv_obj *obj, ktv_field *field, void *value);
+ktv_array *ktv_array_new_objs_index(ktv_obj *obj, uint8_t field_index, uint16_t capacity);
+void ktv_obj_decode_bytes(ktv_obj *obj, uint8_t *data, size_t size, ktv_mask *mask);
+
+ktv_obj *ktv_obj_new(ktv_tree *tree, const char *name)
+{
+    uint8_t index = ktv_find_model_index(tree, name);
+    if (index == INDEX_INVALID)
+    {
+        return NULL;
+    }
+    return ktv_obj_new_index(tree, NULL, index);
+}
+
+ktv_obj *ktv_obj_new_in(ktv_arena *arena, ktv_tree *tree, const char *name)
+{
+    uint8_t index = ktv_find_model_index(tree, name);
+    if (index == INDEX_INVALID)
+    {
+        return NULL;
+    }
+    return ktv_obj_new_index(tree, arena, index);
+}
+
+ktv_obj *ktv_obj_new_index(ktv_tree *tree, ktv_arena *arena, uint8_t index)
+{
+    ktv_model *model = tree->models[index];
+    // one allocation: object followed by its presence bitmap & field slots
+    size_t size = sizeof(ktv_obj) + model->data_size;
+    ktv_obj *obj = arena != NULL ? ktv_arena_alloc(arena, size) : ktv_pool_obj_take(tree, index, size);
+    obj->tree = tree;
+    obj->arena = arena;
+    obj->model_index = index;
+    obj->data = (uint8_t *)(obj + 1);
+    memset(obj->data, 0, model->data_size);
+    return obj;
+}
+
+void ktv_obj_delete(ktv_obj *obj)
+{
+    // arena objects are released with their arena
+    if (obj == NULL || obj->arena != NULL)
+    {
+        return;
+    }
+    ktv_model *model = obj->tree->models[obj->model_index];
+    for (size_t i = 0; i < model->field_count; i++)
+    {
+        if (ktv_type_size(model->fields[i]->type) == 0)
+        {
+            void **slot = ktv_obj_slot(obj, i);
+            ktv_obj_release_value(obj, model->fields[i], slot[0]);
+            ktv_obj_release_value(obj, model->fields[i], slot[1]);
+        }
+    }
+    ktv_pool_obj_give(obj);
+}
+
+void ktv_obj_release_value(ktv_obj *obj, ktv_field *field, void *value)
+{
+    if (value == NULL || obj->arena != NULL)
+    {
+        return;
+    }
+    if (field->type == KTV_TMODEL)
+    {
+        ktv_obj_delete((ktv_obj *)value);
+    }
+    else
+    {
+        ktv_array_delete((ktv_array *)value);
+    }
+}
+
+/**
+ * move the value of an array / model field into its spare slot, reset for reuse by the next decode
+ */
+void ktv_obj_park_value(ktv_obj *obj, uint8_t field_index)
+{
+    ktv_field *field = obj->tree->models[obj->model_index]->fields[field_index];
+    void **slot = ktv_obj_slot(obj, field_index);
+    void *value = slot[0];
+    if (value == NULL)
+    {
+        return;
+    }
+    if (field->type == KTV_TMODEL)
+    {
+        ktv_obj_reset((ktv_obj *)value);
+    }
+    else if (field->type == KTV_TMODEL_ARRAY)
+    {
+        ktv_array *array = (ktv_array *)value;
+        for (size_t j = 0; j < array->count; j++)
+        {
+            ktv_obj_reset(array->objects[j]);
+        }
+    }
+    ktv_obj_release_value(obj, field, slot[1]);
+    slot[1] = value;
+    slot[0] = NULL;
+}
+
+void ktv_obj_reset(ktv_obj *obj)
+{
+    if (obj == NULL)
+    {
+        return;
+    }
+    ktv_model *model = obj->tree->models[obj->model_index];
+    memset(obj->data, 0, (model->field_count + 7) / 8);
+    for (size_t i = 0; i < model->field_count; i++)
+    {
+        ktv_field *field = model->fields[i];
+        if (ktv_type_size(field->type) > 0)
+        {
+            memset(obj->data + model->offsets[i], 0, ktv_type_size(field->type));
+            continue;
+        }
+        ktv_obj_park_value(obj, i);
+    }
+}
+
+/**
+ * nested object for decode, reusing the one kept by ktv_obj_reset if any
+ */
+ktv_obj *ktv_obj_reuse_obj(ktv_obj *obj, uint8_t field_index, uint8_t model_index)
+{
+    // a value still set (object decoded into without ktv_obj_reset) is replaced, so it is recycled too
+    ktv_obj_park_value(obj, field_index);
+    void **spare = ktv_obj_slot(obj, field_index) + 1;
+    ktv_obj *value = (ktv_obj *)*spare;
+    *spare = NULL;
+    return value != NULL ? value : ktv_obj_new_index(obj->tree, obj->arena, model_index);
+}
+
+/**
+ * array of count elements for decode, reusing the one kept by ktv_obj_reset if its capacity is enough
+ * elements of a reused model array keep their (reset) objects
+ */
+ktv_array *ktv_obj_reuse_array(ktv_obj *obj, uint8_t field_index, uint16_t count)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    ktv_obj_park_value(obj, field_index);
+    void **spare = ktv_obj_slot(obj, field_index) + 1;
+    ktv_array *array = (ktv_array *)*spare;
+    *spare = NULL;
+    if (array != NULL && array->capacity >= count)
+    {
+        array->count = count;
+        return array;
+    }
+    ktv_array_delete(array);
+    ktv_field *field = model->fields[field_index];
+    if (field->type == KTV_TMODEL_ARRAY)
+    {
+        return ktv_array_new_objs_index(obj, field_index, count);
+    }
+    array = ktv_array_new_basic_index(obj, field_index, count);
+    array->values = ktv_obj_alloc(obj->arena, ktv_type_size(field->sub_type) * count);
+    return array;
+}
+
+void ktv_obj_set_char(ktv_obj *obj, const char *alias, char new_value)
+{
+    ktv_obj_set_char_by_index(obj, ktv_find_field_index(obj, alias, KTV_TCHAR), new_value);
+}
+
+void ktv_obj_set_char_by_index(ktv_obj *obj, uint8_t field_index, char new_value)
+{
+    void *value = ktv_obj_scalar_slot(obj, field_index, KTV_TCHAR);
+    if (value != NULL)
+    {
+        *(char *)value = new_value;
+    }
+}
+
+char ktv_obj_get_char(ktv_obj *obj, const char *alias)
+{
+    void *value = ktv_obj_get_value_ptr(obj, alias, KTV_TCHAR);
+    return value != NULL ? *(char *)value : 0;
+}
+
+void ktv_obj_set_byte(ktv_obj *obj, const char *alias, int8_t new_value)
+{
+    ktv_obj_set_byte_by_index(obj, ktv_find_field_index(obj, alias, KTV_TBYTE), new_value);
+}
+
+void ktv_obj_set_byte_by_index(ktv_obj *obj, uint8_t field_index, int8_t new_value)
+{
+    void *value = ktv_obj_scalar_slot(obj, field_index, KTV_TBYTE);
+    if (value != NULL)
+    {
+        *(int8_t *)value = new_value;
+    }
+}
+
+int8_t ktv_obj_get_byte(ktv_obj *obj, const char *alias)
+{
+    void *value = ktv_obj_get_value_ptr(obj, alias, KTV_TBYTE);
+    return value != NULL ? *(int8_t *)value : 0;
+}
+
+void ktv_obj_set_int2(ktv_obj *obj, const char *alias, int16_t new_value)
+{
+    ktv_obj_set_int2_by_index(obj, ktv_find_field_index(obj, alias, KTV_TINT2), new_value);
+}
+
+void ktv_obj_set_int2_by_index(ktv_obj *obj, uint8_t field_index, int16_t new_value)
+{
+    void *value = ktv_obj_scalar_slot(obj, field_index, KTV_TINT2);
+    if (value != NULL)
+    {
+        *(int16_t *)value = new_value;
+    }
+}
+
+int16_t ktv_obj_get_int2(ktv_obj *obj, const char *alias)
+{
+    void *value = ktv_obj_get_value_ptr(obj, alias, KTV_TINT2);
+    return value != NULL ? *(int16_t *)value : 0;
+}
+
+void ktv_obj_set_int4(ktv_obj *obj, const char *alias, int32_t new_value)
+{
+    ktv_obj_set_int4_by_index(obj, ktv_find_field_index(obj, alias, KTV_TINT4), new_value);
+}
+
+void ktv_obj_set_int4_by_index(ktv_obj *obj, uint8_t field_index, int32_t new_value)
+{
+    void *value = ktv_obj_scalar_slot(obj, field_index, KTV_TINT4);
+    if (value != NULL)
+    {
+        *(int32_t *)value = new_value;
+    }
+}
+
+int32_t ktv_obj_get_int4(ktv_obj *obj, const char *alias)
+{
+    void *value = ktv_obj_get_value_ptr(obj, alias, KTV_TINT4);
+    return value != NULL ? *(int32_t *)value : 0;
+}
+
+void ktv_obj_set_obj(ktv_obj *obj, const char *alias, ktv_obj *value)
+{
+    ktv_obj_set_obj_by_index(obj, ktv_find_field_index(obj, alias, KTV_TMODEL), value);
+}
+
+void ktv_obj_set_obj_by_index(ktv_obj *obj, uint8_t field_index, ktv_obj *value)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    if (field_index >= model->field_count || model->fields[field_index]->type != KTV_TMODEL)
+    {
+        return;
+    }
+    // todo: delete replaced obj?
+    *ktv_obj_slot(obj, field_index) = value;
+}
+
+ktv_obj *ktv_obj_get_obj(ktv_obj *obj, const char *alias)
+{
+    void *value = ktv_obj_get_value_ptr(obj, alias, KTV_TMODEL);
+    return (ktv_obj *)value;
+}
+
+void ktv_obj_set_array(ktv_obj *obj, const char *alias, ktv_array *value)
+{
+    if (value == NULL)
+    {
+        return;
+    }
+    ktv_obj_set_array_by_index(obj, ktv_find_field_index(obj, alias, value->type), value);
+}
+
+void ktv_obj_set_array_by_index(ktv_obj *obj, uint8_t field_index, ktv_array *value)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    if (value == NULL || field_index >= model->field_count)
+    {
+        return;
+    }
+    ktv_field *field = model->fields[field_index];
+    if (field->type != value->type || field->sub_type != value->sub_type)
+    {
+        return;
+    }
+    // todo: delete replaced array?
+    *ktv_obj_slot(obj, field_index) = value;
+}
+
+ktv_array *ktv_obj_get_array(ktv_obj *obj, const char *alias)
+{
+    void *value = ktv_obj_get_value_ptr(obj, alias, KTV_TARRAY);
+    if (value == NULL)
+    {
+        value = ktv_obj_get_value_ptr(obj, alias, KTV_TMODEL_ARRAY);
+    }
+    return (ktv_array *)value;
+}
+
+ktv_model_handle ktv_model_resolve(ktv_tree *tree, const char *name)
+{
+    ktv_model_handle handle = {tree, ktv_find_model_index(tree, name)};
+    return handle;
+}
+
+ktv_field_handle ktv_field_resolve(ktv_tree *tree, const char *name, const char *alias)
+{
+    ktv_field_handle handle = {tree, INDEX_INVALID, INDEX_INVALID, 0, 0};
+    uint8_t model_index = ktv_find_model_index(tree, name);
+    if (model_index == INDEX_INVALID)
+    {
+        return handle;
+    }
+    ktv_model *model = tree->models[model_index];
+    uint8_t field_index = ktv_model_alias_index(model, alias, 0);
+    if (field_index != INDEX_INVALID)
+    {
+        handle.model_index = model_index;
+        handle.field_index = field_index;
+        handle.type = model->fields[field_index]->type;
+        handle.offset = model->offsets[field_index];
+    }
+    return handle;
+}
+
+ktv_obj *ktv_obj_new_h(ktv_tree *tree, ktv_model_handle model)
+{
+    if (model.tree != tree || model.model_index >= tree->model_count)
+    {
+        return NULL;
+    }
+    return ktv_obj_new_index(tree, NULL, model.model_index);
+}
+
+/**
+ * whether field handle was resolved against object's tree & model, offsets of another tree do not fit its data
+ */
+int ktv_obj_owns_h(ktv_obj *obj, ktv_field_handle field)
+{
+    return field.tree == obj->tree && field.model_index == obj->model_index;
+}
+
+/**
+ * inline slot of a scalar field handle, NULL if handle does not belong to object's model or type
+ */
+void *ktv_obj_slot_h(ktv_obj *obj, ktv_field_handle field, uint8_t type)
+{
+    if (!ktv_obj_owns_h(obj, field) || field.type != type)
+    {
+        return NULL;
+    }
+    return obj->data + field.offset;
+}
+
+void ktv_obj_set_char_h(ktv_obj *obj, ktv_field_handle field, char value)
+{
+    char *slot = ktv_obj_slot_h(obj, field, KTV_TCHAR);
+    if (slot != NULL)
+    {
+        obj->data[field.field_index / 8] |= 1 << (field.field_index % 8);
+        *slot = value;
+    }
+}
+
+char ktv_obj_get_char_h(ktv_obj *obj, ktv_field_handle field)
+{
+    char *slot = ktv_obj_slot_h(obj, field, KTV_TCHAR);
+    return slot != NULL ? *slot : 0;
+}
+
+void ktv_obj_set_byte_h(ktv_obj *obj, ktv_field_handle field, int8_t value)
+{
+    int8_t *slot = ktv_obj_slot_h(obj, field, KTV_TBYTE);
+    if (slot != NULL)
+    {
+        obj->data[field.field_index / 8] |= 1 << (field.field_index % 8);
+        *slot = value;
+    }
+}
+
+int8_t ktv_obj_get_byte_h(ktv_obj *obj, ktv_field_handle field)
+{
+    int8_t *slot = ktv_obj_slot_h(obj, field, KTV_TBYTE);
+    return slot != NULL ? *slot : 0;
+}
+
+void ktv_obj_set_int2_h(ktv_obj *obj, ktv_field_handle field, int16_t value)
+{
+    int16_t *slot = ktv_obj_slot_h(obj, field, KTV_TINT2);
+    if (slot != NULL)
+    {
+        obj->data[field.field_index / 8] |= 1 << (field.field_index % 8);
+        *slot = value;
+    }
+}
+
+int16_t ktv_obj_get_int2_h(ktv_obj *obj, ktv_field_handle field)
+{
+    int16_t *slot = ktv_obj_slot_h(obj, field, KTV_TINT2);
+    return slot != NULL ? *slot : 0;
+}
+
+void ktv_obj_set_int4_h(ktv_obj *obj, ktv_field_handle field, int32_t value)
+{
+    int32_t *slot = ktv_obj_slot_h(obj, field, KTV_TINT4);
+    if (slot != NULL)
+    {
+        obj->data[field.field_index / 8] |= 1 << (field.field_index % 8);
+        *slot = value;
+    }
+}
+
+int32_t ktv_obj_get_int4_h(ktv_obj *obj, ktv_field_handle field)
+{
+    int32_t *slot = ktv_obj_slot_h(obj, field, KTV_TINT4);
+    return slot != NULL ? *slot : 0;
+}
+
+void ktv_obj_set_obj_h(ktv_obj *obj, ktv_field_handle field, ktv_obj *value)
+{
+    if (ktv_obj_owns_h(obj, field))
+    {
+        ktv_obj_set_obj_by_index(obj, field.field_index, value);
+    }
+}
+
+ktv_obj *ktv_obj_get_obj_h(ktv_obj *obj, ktv_field_handle field)
+{
+    ktv_obj **slot = ktv_obj_slot_h(obj, field, KTV_TMODEL);
+    return slot != NULL ? *slot : NULL;
+}
+
+void ktv_obj_set_array_h(ktv_obj *obj, ktv_field_handle field, ktv_array *value)
+{
+    if (ktv_obj_owns_h(obj, field))
+    {
+        ktv_obj_set_array_by_index(obj, field.field_index, value);
+    }
+}
+
+ktv_array *ktv_obj_get_array_h(ktv_obj *obj, ktv_field_handle field)
+{
+    if (!ktv_obj_owns_h(obj, field) || (field.type != KTV_TARRAY && field.type != KTV_TMODEL_ARRAY))
+    {
+        return NULL;
+    }
+    return *(ktv_array **)(obj->data + field.offset);
+}
+
+ktv_array *ktv_array_new_string(ktv_obj *obj, const char *alias, char *values, uint16_t count)
+{
+    ktv_array *array = ktv_array_new_basic(obj, alias, count);
+    array->values = ktv_obj_alloc(obj->arena, sizeof(char) * count);
+    for (size_t i = 0; i < count; i++)
+    {
+        ((char *)array->values)[i] = values[i];
+    }
+    return array;
+}
+
+ktv_array *ktv_array_new_bytes(ktv_obj *obj, const char *alias, int8_t *values, uint16_t count)
+{
+    ktv_array *array = ktv_array_new_basic(obj, alias, count);
+    array->values = ktv_obj_alloc(obj->arena, sizeof(int8_t) * count);
+    for (size_t i = 0; i < count; i++)
+    {
+        ((int8_t *)array->values)[i] = values[i];
+    }
+    return array;
+}
+
+ktv_array *ktv_array_new_int2s(ktv_obj *obj, const char *alias, int16_t *values, uint16_t count)
+{
+    ktv_array *array = ktv_array_new_basic(obj, alias, count);
+    array->values = ktv_obj_alloc(obj->arena, sizeof(int16_t) * count);
+    for (size_t i = 0; i < count; i++)
+    {
+        ((int16_t *)array->values)[i] = values[i];
+    }
+    return array;
+}
+
+ktv_array *ktv_array_new_int4s(ktv_obj *obj, const char *alias, int32_t *values, uint16_t count)
+{
+    ktv_array *array = ktv_array_new_basic(obj, alias, count);
+    array->values = ktv_obj_alloc(obj->arena, sizeof(int32_t) * count);
+    for (size_t i = 0; i < count; i++)
+    {
+        ((int32_t *)array->values)[i] = values[i];
+    }
+    return array;
+}
+
+ktv_array *ktv_array_new_objs_index(ktv_obj *obj, uint8_t field_index, uint16_t capacity)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    if (field_index >= model->field_count || model->fields[field_index]->type != KTV_TMODEL_ARRAY || capacity == 0)
+    {
+        return NULL;
+    }
+    ktv_field *field = model->fields[field_index];
+    ktv_array *array = obj->arena != NULL ? ktv_arena_alloc(obj->arena, sizeof(ktv_array)) : ktv_pool_array_take();
+    array->arena = obj->arena;
+    array->type = field->type;
+    array->sub_type = field->sub_type;
+    array->values = NULL;
+    array->count = capacity;
+    array->capacity = capacity;
+    array->objects = ktv_obj_alloc(obj->arena, sizeof(ktv_obj *) * capacity);
+    for (size_t i = 0; i < capacity; i++)
+    {
+        array->objects[i] = NULL;
+    }
+
+    return array;
+}
+
+ktv_array *ktv_array_new_objs(ktv_obj *obj, const char *alias, uint16_t capacity)
+{
+    return ktv_array_new_objs_index(obj, ktv_find_field_index(obj, alias, KTV_TMODEL_ARRAY), capacity);
+}
+
+void ktv_array_delete(ktv_array *array)
+{
+    if (array == NULL || array->arena != NULL)
+    {
+        return;
+    }
+    if (array->type == KTV_TARRAY)
+    {
+        if (array->values != NULL)
+        {
+            free(array->values);
+        }
+        ktv_pool_array_give(array);
+        return;
+    }
+    for (size_t i = 0; i < array->capacity; i++)
+    {
+        if (array->objects[i] != NULL)
+        {
+            ktv_obj_delete(array->objects[i]);
+        }
+    }
+    free(array->objects);
+    ktv_pool_array_give(array);
+}
+
+char *ktv_array_get_string(ktv_array *array)
+{
+    return (char *)array->values;
+}
+
+int8_t *ktv_array_get_bytes(ktv_array *array)
+{
+    return (int8_t *)array->values;
+}
+
+int16_t *ktv_array_get_int2s(ktv_array *array)
+{
+    return (int16_t *)array->values;
+}
+
+int32_t *ktv_array_get_int4s(ktv_array *array)
+{
+    return (int32_t *)array->values;
+}
+
+ktv_obj *ktv_array_get_obj(ktv_array *array, uint16_t index)
+{
+    if (index >= array->count)
+    {
+        return NULL;
+    }
+    return array->objects[index];
+}
+
+void ktv_array_set_obj(ktv_array *array, uint16_t index, ktv_obj *obj)
+{
+    if (index >= array->count)
+    {
+        return;
+    }
+    array->objects[index] = obj;
+}
+
+size_t ktv_field_encoded_size(ktv_field *field, void *value)
+{
+    if (field->type == KTV_TMODEL)
+    {
+        return 2 + ktv_obj_encoded_size((ktv_obj *)value);
+    }
+    else if (field->type == KTV_TARRAY)
+    {
+        ktv_array *array_value = (ktv_array *)value;
+        return 2 + (array_value != NULL ? array_value->count * ktv_type_size(field->sub_type) : 0);
+    }
+    else if (field->type == KTV_TMODEL_ARRAY)
+    {
+        ktv_array *array_value = (ktv_array *)value;
+        size_t size = 2;
+        for (size_t j = 0; array_value != NULL && j < array_value->count; j++)
+        {
+            size += 2 + ktv_obj_encoded_size(array_value->objects[j]);
+        }
+        return size;
+    }
+    return ktv_type_size(field->type);
+}
+
+size_t ktv_obj_encoded_size(ktv_obj *obj)
+{
+    if (obj == NULL)
+    {
+        return 0;
+    }
+    ktv_model *model = obj->tree->models[obj->model_index];
+    size_t size = model->fixed_size;
+    for (ktv_op *op = model->ops; op < model->ops + model->op_count; op++)
+    {
+        void *value = op->code != KTV_OP_BLOCK ? *ktv_obj_slot(obj, op->field_index) : NULL;
+        switch (op->code)
+        {
+        case KTV_OP_ARRAY:
+            size += value != NULL ? ((ktv_array *)value)->count * op->size : 0;
+            break;
+        case KTV_OP_MODEL:
+            size += ktv_obj_encoded_size((ktv_obj *)value);
+            break;
+        case KTV_OP_MODEL_ARRAY:
+            for (size_t j = 0; value != NULL && j < ((ktv_array *)value)->count; j++)
+            {
+                size += 2 + ktv_obj_encoded_size(((ktv_array *)value)->objects[j]);
+            }
+            break;
+        }
+    }
+    return size;
+}
+
+/**
+ * write a width byte scalar slot in wire byte order, char & byte share width 1
+ */
+static inline void ktv_copy_scalar_out(const uint8_t *slot, uint8_t width, uint8_t *dst)
+{
+    switch (width)
+    {
+    case 1:
+        dst[0] = slot[0];
+        break;
+    case 2:
+        ktv_int2_to_bytes(*(const int16_t *)slot, dst);
+        break;
+    case 4:
+        ktv_int4_to_bytes(*(const int32_t *)slot, dst);
+        break;
+    }
+}
+
+static inline void ktv_copy_scalar_in(const uint8_t *src, uint8_t width, uint8_t *slot)
+{
+    switch (width)
+    {
+    case 1:
+        slot[0] = src[0];
+        break;
+    case 2:
+        *(int16_t *)slot = ktv_bytes_to_int2((uint8_t *)src);
+        break;
+    case 4:
+        *(int32_t *)slot = ktv_bytes_to_int4((uint8_t *)src);
+        break;
+    }
+}
+
+uint8_t *ktv_write_scalar(void *value, uint8_t type, uint8_t *dst)
+{
+    uint8_t width = ktv_type_size(type);
+    if (value != NULL)
+    {
+        ktv_copy_scalar_out((uint8_t *)value, width, dst);
+    }
+    else
+    {
+        memset(dst, 0, width);
+    }
+    return dst + width;
+}
+
+uint8_t *ktv_write_array_values(ktv_array *array, uint8_t sub_type, uint8_t *dst)
+{
+    if (sub_type == KTV_TBYTE || sub_type == KTV_TCHAR)
+    {
+        memcpy(dst, array->values, array->count);
+        dst += array->count;
+    }
+    else if (sub_type == KTV_TINT2)
+    {
+        ktv_int2s_to_bytes((int16_t *)array->values, dst, array->count);
+        dst += array->count * 2;
+    }
+    else if (sub_type == KTV_TINT4)
+    {
+        ktv_int4s_to_bytes((int32_t *)array->values, dst, array->count);
+        dst += array->count * 4;
+    }
+    return dst;
+}
+
+uint8_t *ktv_obj_write(ktv_obj *obj, uint8_t *dst);
+
+uint8_t *ktv_obj_write_field(ktv_field *field, void *value, uint8_t *dst)
+{
+    if (field->type == KTV_TMODEL)
+    {
+        uint8_t *model_start = dst + 2;
+        uint8_t *model_end = value != NULL ? ktv_obj_write((ktv_obj *)value, model_start) : model_start;
+        ktv_int2_to_bytes(model_end - model_start, dst);
+        return model_end;
+    }
+    else if (field->type == KTV_TARRAY)
+    {
+        ktv_array *array_value = (ktv_array *)value;
+        uint16_t count = array_value != NULL ? array_value->count : 0;
+        ktv_int2_to_bytes(count, dst);
+        dst += 2;
+        if (count > 0)
+        {
+            dst = ktv_write_array_values(array_value, field->sub_type, dst);
+        }
+        return dst;
+    }
+    else if (field->type == KTV_TMODEL_ARRAY)
+    {
+        ktv_array *array_value = (ktv_array *)value;
+        uint16_t count = array_value != NULL ? array_value->count : 0;
+        ktv_int2_to_bytes(count, dst);
+        dst += 2;
+        for (size_t j = 0; j < count; j++)
+        {
+            ktv_obj *item = array_value->objects[j];
+            uint8_t *model_start = dst + 2;
+            uint8_t *model_end = item != NULL ? ktv_obj_write(item, model_start) : model_start;
+            ktv_int2_to_bytes(model_end - model_start, dst);
+            dst = model_end;
+        }
+        return dst;
+    }
+    return ktv_write_scalar(value, field->type, dst);
+}
+
+/**
+ * write encoded obj into dst (at least ktv_obj_encoded_size bytes)
+ * nested models are written in place and their length prefix is patched afterwards
+ * returns the end of written bytes
+ */
+uint8_t *ktv_obj_write(ktv_obj *obj, uint8_t *dst)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    for (ktv_op *op = model->ops; op < model->ops + model->op_count; op++)
+    {
+        if (op->code != KTV_OP_BLOCK)
+        {
+            dst = ktv_obj_write_field(model->fields[op->field_index], *ktv_obj_slot(obj, op->field_index), dst);
+            continue;
+        }
+        // unset scalar slots hold 0, which is also what an unset scalar encodes to
+        for (ktv_scalar_op *scalar = model->scalars + op->field_index;
+             scalar < model->scalars + op->field_index + op->field_count; scalar++)
+        {
+            ktv_copy_scalar_out(obj->data + scalar->offset, scalar->width, dst);
+            dst += scalar->width;
+        }
+    }
+    return dst;
+}
+
+size_t ktv_obj_encode_into(ktv_obj *obj, uint8_t *dst, size_t capacity)
+{
+    if (obj == NULL || dst == NULL)
+    {
+        return 0;
+    }
+    size_t size = ktv_obj_encoded_size(obj);
+    if (size > capacity)
+    {
+        return 0;
+    }
+    ktv_obj_write(obj, dst);
+    return size;
+}
+
+typedef struct ktv_iov_writer
+{
+    uint8_t *scratch;
+    size_t scratch_size;
+    size_t scratch_capacity;
+    ktv_iovec *iov;
+    size_t iov_count;
+    size_t iov_capacity;
+    size_t size;
+    int overflow;
+} ktv_iov_writer;
+
+/**
+ * take size bytes from scratch, merged into the last iovec if it ends right there
+ */
+uint8_t *ktv_iov_reserve(ktv_iov_writer *writer, size_t size)
+{
+    if (writer->overflow || writer->scratch_size + size > writer->scratch_capacity)
+    {
+        writer->overflow = 1;
+        return NULL;
+    }
+    uint8_t *data = writer->scratch + writer->scratch_size;
+    ktv_iovec *last = writer->iov_count > 0 ? &writer->iov[writer->iov_count - 1] : NULL;
+    if (last != NULL && (uint8_t *)last->iov_base + last->iov_len == data)
+    {
+        last->iov_len += size;
+    }
+    else if (writer->iov_count < writer->iov_capacity)
+    {
+        writer->iov[writer->iov_count].iov_base = data;
+        writer->iov[writer->iov_count].iov_len = size;
+        writer->iov_count++;
+    }
+    else
+    {
+        writer->overflow = 1;
+        return NULL;
+    }
+    writer->scratch_size += size;
+    writer->size += size;
+    return data;
+}
+
+void ktv_iov_reference(ktv_iov_writer *writer, uint8_t *data, size_t size)
+{
+    if (size < KTV_IOV_MIN_REF_SIZE)
+    {
+        uint8_t *copy = ktv_iov_reserve(writer, size);
+        if (copy != NULL)
+        {
+            memcpy(copy, data, size);
+        }
+        return;
+    }
+    if (writer->overflow || writer->iov_count >= writer->iov_capacity)
+    {
+        writer->overflow = 1;
+        return;
+    }
+    writer->iov[writer->iov_count].iov_base = data;
+    writer->iov[writer->iov_count].iov_len = size;
+    writer->iov_count++;
+    writer->size += size;
+}
+
+void ktv_obj_write_iov(ktv_obj *obj, ktv_iov_writer *writer)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    uint8_t field_count = model->field_count;
+    for (size_t i = 0; i < field_count && !writer->overflow; i++)
+    {
+        ktv_field *field = model->fields[i];
+        void *value = ktv_obj_get_value_by_index(obj, i);
+        if (field->type == KTV_TMODEL)
+        {
+            uint8_t *model_length = ktv_iov_reserve(writer, 2);
+            size_t model_start = writer->size;
+            if (value != NULL)
+            {
+                ktv_obj_write_iov((ktv_obj *)value, writer);
+            }
+            if (model_length != NULL)
+            {
+                ktv_int2_to_bytes(writer->size - model_start, model_length);
+            }
+        }
+        else if (field->type == KTV_TARRAY)
+        {
+            ktv_array *array_value = (ktv_array *)value;
+            uint16_t count = array_value != NULL ? array_value->count : 0;
+            uint8_t *array_count = ktv_iov_reserve(writer, 2);
+            if (array_count == NULL)
+            {
+                continue;
+            }
+            ktv_int2_to_bytes(count, array_count);
+            if (count == 0)
+            {
+                continue;
+            }
+            if (field->sub_type == KTV_TBYTE || field->sub_type == KTV_TCHAR)
+            {
+                ktv_iov_reference(writer, (uint8_t *)array_value->values, count);
+                continue;
+            }
+            size_t size = ktv_type_size(field->sub_type);
+            uint8_t *data = ktv_iov_reserve(writer, count * size);
+            if (data == NULL)
+            {
+                continue;
+            }
+            // int2 / int4 payloads need byte order conversion, so they go through scratch
+            ktv_write_array_values(array_value, field->sub_type, data);
+        }
+        else if (field->type == KTV_TMODEL_ARRAY)
+        {
+            ktv_array *array_value = (ktv_array *)value;
+            uint16_t count = array_value != NULL ? array_value->count : 0;
+            uint8_t *array_count = ktv_iov_reserve(writer, 2);
+            if (array_count == NULL)
+            {
+                continue;
+            }
+            ktv_int2_to_bytes(count, array_count);
+            for (size_t j = 0; j < count && !writer->overflow; j++)
+            {
+                ktv_obj *item = array_value->objects[j];
+                uint8_t *model_length = ktv_iov_reserve(writer, 2);
+                size_t model_start = writer->size;
+                if (item != NULL)
+                {
+                    ktv_obj_write_iov(item, writer);
+                }
+                if (model_length != NULL)
+                {
+                    ktv_int2_to_bytes(writer->size - model_start, model_length);
+                }
+            }
+        }
+        else
+        {
+            size_t size = ktv_type_size(field->type);
+            uint8_t *data = ktv_iov_reserve(writer, size);
+            if (data != NULL)
+            {
+                ktv_write_scalar(value, field->type, data);
+            }
+        }
+    }
+}
+
+size_t ktv_obj_encode_iov(ktv_obj *obj, uint8_t *scratch, size_t scratch_capacity, ktv_iovec *iov, size_t *iov_count)
+{
+    if (obj == NULL || scratch == NULL || iov == NULL || iov_count == NULL)
+    {
+        return 0;
+    }
+    ktv_iov_writer writer = {scratch, 0, scratch_capacity, iov, 0, *iov_count, 0, 0};
+    ktv_obj_write_iov(obj, &writer);
+    if (writer.overflow)
+    {
+        return 0;
+    }
+    *iov_count = writer.iov_count;
+    return writer.size;
+}
+
+typedef struct ktv_stream_writer
+{
+    uint8_t *chunk;
+    size_t chunk_used;
+    size_t chunk_size;
+    ktv_sink sink;
+    void *context;
+    size_t size;
+    int aborted;
+    uint16_t *model_sizes; // length prefix of every nested model, in the order they are streamed
+    size_t model_count;
+    size_t model_capacity;
+    size_t model_next;
+} ktv_stream_writer;
+
+/**
+ * slot for the length prefix of the next nested model, SIZE_MAX and writer aborted if out of memory
+ */
+size_t ktv_stream_reserve_size(ktv_stream_writer *writer)
+{
+    if (writer->aborted)
+    {
+        return SIZE_MAX;
+    }
+    if (writer->model_count == writer->model_capacity)
+    {
+        size_t capacity = writer->model_capacity > 0 ? writer->model_capacity * 2 : 16;
+        uint16_t *model_sizes = realloc(writer->model_sizes, sizeof(uint16_t) * capacity);
+        if (model_sizes == NULL)
+        {
+            writer->aborted = 1;
+            return SIZE_MAX;
+        }
+        writer->model_sizes = model_sizes;
+        writer->model_capacity = capacity;
+    }
+    return writer->model_count++;
+}
+
+/**
+ * size obj and record the length prefix of each nested model it holds, one bottom-up pass over the whole graph
+ */
+size_t ktv_stream_size_obj(ktv_obj *obj, ktv_stream_writer *writer)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    size_t size = 0;
+    for (size_t i = 0; i < model->field_count; i++)
+    {
+        ktv_field *field = model->fields[i];
+        void *value = ktv_obj_get_value_by_index(obj, i);
+        if (field->type == KTV_TMODEL)
+        {
+            size_t slot = ktv_stream_reserve_size(writer);
+            if (slot == SIZE_MAX)
+            {
+                return 0;
+            }
+            size_t model_size = value != NULL ? ktv_stream_size_obj((ktv_obj *)value, writer) : 0;
+            writer->model_sizes[slot] = model_size;
+            size += 2 + model_size;
+        }
+        else if (field->type == KTV_TMODEL_ARRAY)
+        {
+            ktv_array *array_value = (ktv_array *)value;
+            size += 2;
+            for (size_t j = 0; array_value != NULL && j < array_value->count; j++)
+            {
+                ktv_obj *item = array_value->objects[j];
+                size_t slot = ktv_stream_reserve_size(writer);
+                if (slot == SIZE_MAX)
+                {
+                    return 0;
+                }
+                size_t model_size = item != NULL ? ktv_stream_size_obj(item, writer) : 0;
+                writer->model_sizes[slot] = model_size;
+                size += 2 + model_size;
+            }
+        }
+        else
+        {
+            size += ktv_field_encoded_size(field, value);
+        }
+    }
+    return size;
+}
+
+void ktv_stream_flush(ktv_stream_writer *writer)
+{
+    if (writer->aborted || writer->chunk_used == 0)
+    {
+        return;
+    }
+    if (writer->sink(writer->context, writer->chunk, writer->chunk_used) != 0)
+    {
+        writer->aborted = 1;
+    }
+    writer->chunk_used = 0;
+}
+
+void ktv_stream_put(ktv_stream_writer *writer, uint8_t *data, size_t size)
+{
+    while (size > 0 && !writer->aborted)
+    {
+        size_t room = writer->chunk_size - writer->chunk_used;
+        size_t copy = size < room ? size : room;
+        memcpy(writer->chunk + writer->chunk_used, data, copy);
+        writer->chunk_used += copy;
+        writer->size += copy;
+        data += copy;
+        size -= copy;
+        if (writer->chunk_used == writer->chunk_size)
+        {
+            ktv_stream_flush(writer);
+        }
+    }
+}
+
+void ktv_stream_put_model(ktv_stream_writer *writer, ktv_obj *obj);
+
+void ktv_obj_write_stream(ktv_obj *obj, ktv_stream_writer *writer)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    uint8_t field_count = model->field_count;
+    uint8_t data[4];
+    for (size_t i = 0; i < field_count && !writer->aborted; i++)
+    {
+        ktv_field *field = model->fields[i];
+        void *value = ktv_obj_get_value_by_index(obj, i);
+        if (field->type == KTV_TMODEL)
+        {
+            ktv_stream_put_model(writer, (ktv_obj *)value);
+        }
+        else if (field->type == KTV_TARRAY)
+        {
+            ktv_array *array_value = (ktv_array *)value;
+            uint16_t count = array_value != NULL ? array_value->count : 0;
+            ktv_int2_to_bytes(count, data);
+            ktv_stream_put(writer, data, 2);
+            if (count == 0)
+            {
+                continue;
+            }
+            if (field->sub_type == KTV_TBYTE || field->sub_type == KTV_TCHAR)
+            {
+                ktv_stream_put(writer, (uint8_t *)array_value->values, count);
+                continue;
+            }
+            // convert int2 / int4 values block by block
+            uint8_t block[64];
+            size_t type_size = ktv_type_size(field->sub_type);
+            size_t block_count = sizeof(block) / type_size;
+            for (size_t j = 0; j < count && !writer->aborted; j += block_count)
+            {
+                ktv_array slice = *array_value;
+                slice.values = (uint8_t *)array_value->values + j * type_size;
+                slice.count = count - j < block_count ? count - j : block_count;
+                uint8_t *end = ktv_write_array_values(&slice, field->sub_type, block);
+                ktv_stream_put(writer, block, end - block);
+            }
+        }
+        else if (field->type == KTV_TMODEL_ARRAY)
+        {
+            ktv_array *array_value = (ktv_array *)value;
+            uint16_t count = array_value != NULL ? array_value->count : 0;
+            ktv_int2_to_bytes(count, data);
+            ktv_stream_put(writer, data, 2);
+            for (size_t j = 0; j < count && !writer->aborted; j++)
+            {
+                ktv_stream_put_model(writer, array_value->objects[j]);
+            }
+        }
+        else
+        {
+            uint8_t *end = ktv_write_scalar(value, field->type, data);
+            ktv_stream_put(writer, data, end - data);
+        }
+    }
+}
+
+/**
+ * bytes already handed to the sink can not be patched,
+ * so length prefix of nested model comes from the sizing pass done before streaming
+ */
+void ktv_stream_put_model(ktv_stream_writer *writer, ktv_obj *obj)
+{
+    uint8_t model_length[2];
+    ktv_int2_to_bytes(writer->model_sizes[writer->model_next++], model_length);
+    ktv_stream_put(writer, model_length, 2);
+    if (obj != NULL)
+    {
+        ktv_obj_write_stream(obj, writer);
+    }
+}
+
+size_t ktv_obj_encode_stream(ktv_obj *obj, uint8_t *chunk, size_t chunk_size, ktv_sink sink, void *context)
+{
+    if (obj == NULL || chunk == NULL || chunk_size == 0 || sink == NULL)
+    {
+        return 0;
+    }
+    ktv_stream_writer writer = {chunk, 0, chunk_size, sink, context, 0, 0, NULL, 0, 0, 0};
+    ktv_stream_size_obj(obj, &writer);
+    if (!writer.aborted)
+    {
+        ktv_obj_write_stream(obj, &writer);
+        ktv_stream_flush(&writer);
+    }
+    free(writer.model_sizes);
+    return writer.aborted ? 0 : writer.size;
+}
+
+ktv_buffer *ktv_obj_encode(ktv_obj *obj)
+{
+    if (obj == NULL)
+    {
+        return NULL;
+    }
+    ktv_buffer *buffer = ktv_buffer_new(NULL, 0);
+    ktv_obj_encode_append(obj, buffer);
+    return buffer;
+}
+
+size_t ktv_obj_encode_append(ktv_obj *obj, ktv_buffer *buffer)
+{
+    if (obj == NULL || buffer == NULL)
+    {
+        return 0;
+    }
+    size_t size = ktv_obj_encoded_size(obj);
+    ktv_buffer_reserve(buffer, buffer->size + size);
+    ktv_obj_write(obj, buffer->buffer + buffer->size);
+    buffer->size += size;
+    return size;
+}
+
+ktv_buffer *ktv_encode_batch(ktv_obj **objs, size_t count, size_t *offsets)
+{
+    if (objs == NULL)
+    {
+        return NULL;
+    }
+    size_t size = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t message_size = ktv_obj_encoded_size(objs[i]);
+        // the frame prefix is 2 bytes, a larger message would corrupt every frame after it
+        if (message_size > UINT16_MAX)
+        {
+            return NULL;
+        }
+        size += 2 + message_size;
+    }
+    // buffer header plus storage sized exactly once, never regrown while writing
+    ktv_buffer *buffer = ktv_buffer_new(NULL, 0);
+    ktv_buffer_reserve(buffer, size);
+    uint8_t *dst = buffer->buffer;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t *message_start = dst + 2;
+        uint8_t *message_end = objs[i] != NULL ? ktv_obj_write(objs[i], message_start) : message_start;
+        ktv_int2_to_bytes(message_end - message_start, dst);
+        if (offsets != NULL)
+        {
+            offsets[i] = message_start - buffer->buffer;
+        }
+        dst = message_end;
+    }
+    buffer->size = size;
+    return buffer;
+}
+
+typedef struct ktv_parallel_job
+{
+    ktv_array *array;
+    size_t *offsets; // element sizes after sizing, element offsets before writing / reading
+    uint8_t *data;   // encoded bytes written / read by tasks
+    size_t size;     // size of data when decoding
+    ktv_tree *tree;  // tree of decoded elements
+} ktv_parallel_job;
+
+void ktv_parallel_size_task(void *argument, size_t slice)
+{
+    ktv_parallel_job *job = (ktv_parallel_job *)argument;
+    size_t end = (slice + 1) * KTV_PARALLEL_SLICE_SIZE;
+    end = end < job->array->count ? end : job->array->count;
+    for (size_t j = slice * KTV_PARALLEL_SLICE_SIZE; j < end; j++)
+    {
+        job->offsets[j] = 2 + ktv_obj_encoded_size(job->array->objects[j]);
+    }
+}
+
+void ktv_parallel_write_task(void *argument, size_t slice)
+{
+    ktv_parallel_job *job = (ktv_parallel_job *)argument;
+    size_t end = (slice + 1) * KTV_PARALLEL_SLICE_SIZE;
+    end = end < job->array->count ? end : job->array->count;
+    for (size_t j = slice * KTV_PARALLEL_SLICE_SIZE; j < end; j++)
+    {
+        ktv_obj *item = job->array->objects[j];
+        uint8_t *model_length = job->data + job->offsets[j];
+        uint8_t *model_end = item != NULL ? ktv_obj_write(item, model_length + 2) : model_length + 2;
+        ktv_int2_to_bytes(model_end - model_length - 2, model_length);
+    }
+}
+
+ktv_buffer *ktv_obj_encode_parallel(ktv_obj *obj, ktv_executor executor, void *context)
+{
+    if (obj == NULL)
+    {
+        return NULL;
+    }
+    if (executor == NULL)
+    {
+        return ktv_obj_encode(obj);
+    }
+    ktv_model *model = obj->tree->models[obj->model_index];
+    ktv_parallel_job *jobs = malloc(sizeof(ktv_parallel_job) * (model->field_count > 0 ? model->field_count : 1));
+    size_t size = 0;
+    // size every field, elements of large model arrays are sized by the executor
+    for (size_t i = 0; i < model->field_count; i++)
+    {
+        ktv_field *field = model->fields[i];
+        ktv_array *array_value = (ktv_array *)ktv_obj_get_value_by_index(obj, i);
+        jobs[i].array = NULL;
+        if (field->type != KTV_TMODEL_ARRAY || array_value == NULL || array_value->count < KTV_PARALLEL_MIN_COUNT)
+        {
+            size += ktv_field_encoded_size(field, array_value);
+            continue;
+        }
+        size_t slices = (array_value->count + KTV_PARALLEL_SLICE_SIZE - 1) / KTV_PARALLEL_SLICE_SIZE;
+        jobs[i].array = array_value;
+        jobs[i].offsets = malloc(sizeof(size_t) * array_value->count);
+        executor(context, ktv_parallel_size_task, &jobs[i], slices);
+        size += 2;
+        for (size_t j = 0; j < array_value->count; j++)
+        {
+            size += jobs[i].offsets[j];
+        }
+    }
+    ktv_buffer *buffer = ktv_buffer_new(NULL, 0);
+    ktv_buffer_reserve(buffer, size);
+    buffer->size = size;
+    // write every field, elements of large model arrays are written in place by the executor
+    uint8_t *dst = buffer->buffer;
+    for (size_t i = 0; i < model->field_count; i++)
+    {
+        if (jobs[i].array == NULL)
+        {
+            dst = ktv_obj_write_field(model->fields[i], ktv_obj_get_value_by_index(obj, i), dst);
+            continue;
+        }
+        ktv_parallel_job *job = &jobs[i];
+        size_t slices = (job->array->count + KTV_PARALLEL_SLICE_SIZE - 1) / KTV_PARALLEL_SLICE_SIZE;
+        ktv_int2_to_bytes(job->array->count, dst);
+        dst += 2;
+        for (size_t j = 0; j < job->array->count; j++)
+        {
+            size_t element_size = job->offsets[j];
+            job->offsets[j] = dst - buffer->buffer;
+            dst += element_size;
+        }
+        job->data = buffer->buffer;
+        executor(context, ktv_parallel_write_task, job, slices);
+        free(job->offsets);
+    }
+    free(jobs);
+    return buffer;
+}
+
+/**
+ * bytes of a nested model at index that are actually inside the input
+ */
+size_t ktv_decode_range(size_t index, size_t length, size_t size)
+{
+    return index >= size ? 0 : (length < size - index ? length : size - index);
+}
+
+/**
+ * wire values of an int2 / int4 / char / byte array -> array values
+ */
+void ktv_read_array_values(ktv_array *array, uint8_t sub_type, uint8_t *src, size_t count)
+{
+    if (sub_type == KTV_TINT2)
+    {
+        ktv_bytes_to_int2s(src, (int16_t *)array->values, count);
+    }
+    else if (sub_type == KTV_TINT4)
+    {
+        ktv_bytes_to_int4s(src, (int32_t *)array->values, count);
+    }
+    else
+    {
+        memcpy(array->values, src, count);
+    }
+}
+
+/**
+ * decode one op of obj's model at data[index]
+ * returns index after the op, or SIZE_MAX if input ends inside a block, a length / count prefix or an array
+ */
+size_t ktv_obj_decode_op(ktv_obj *obj, ktv_op *op, uint8_t *data, size_t index, size_t size, ktv_mask *mask)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    uint8_t *wanted = mask != NULL ? mask->bits + obj->model_index * KTV_MASK_BYTES : NULL;
+    switch (op->code)
+    {
+    case KTV_OP_BLOCK:
+    {
+        // a truncated block stops at its first missing field
+        int complete = index + op->size <= size;
+        for (size_t i = op->field_index; i < op->field_index + op->field_count; i++)
+        {
+            ktv_scalar_op *scalar = &model->scalars[i];
+            if (!complete && index + scalar->width > size)
+            {
+                return SIZE_MAX;
+            }
+            if (wanted == NULL || KTV_MASK_TEST(wanted, i))
+            {
+                ktv_copy_scalar_in(data + index, scalar->width, obj->data + scalar->offset);
+                obj->data[i / 8] |= 1 << (i % 8);
+            }
+            index += scalar->width;
+        }
+        break;
+    }
+    case KTV_OP_ARRAY:
+    {
+        if (index + 2 > size)
+        {
+            return SIZE_MAX;
+        }
+        uint16_t count = ktv_bytes_to_int2(&data[index]);
+        index += 2;
+        if ((size_t)count * op->size > size - index)
+        {
+            return SIZE_MAX;
+        }
+        if (count == 0 || (wanted != NULL && !KTV_MASK_TEST(wanted, op->field_index)))
+        {
+            index += count * op->size;
+            break;
+        }
+        ktv_array *array = ktv_obj_reuse_array(obj, op->field_index, count);
+        ktv_read_array_values(array, op->sub_type, data + index, count);
+        ktv_obj_set_array_by_index(obj, op->field_index, array);
+        index += count * op->size;
+        break;
+    }
+    case KTV_OP_MODEL:
+    {
+        if (index + 2 > size)
+        {
+            return SIZE_MAX;
+        }
+        uint16_t model_size = ktv_bytes_to_int2(&data[index]);
+        index += 2;
+        if (wanted != NULL && !KTV_MASK_TEST(wanted, op->field_index))
+        {
+            index += model_size;
+            break;
+        }
+        ktv_obj *model_obj = ktv_obj_reuse_obj(obj, op->field_index, op->sub_type);
+        ktv_obj_decode_bytes(model_obj, data + index, ktv_decode_range(index, model_size, size), mask);
+        ktv_obj_set_obj_by_index(obj, op->field_index, model_obj);
+        index += model_size;
+        break;
+    }
+    case KTV_OP_MODEL_ARRAY:
+    {
+        if (index + 2 > size)
+        {
+            return SIZE_MAX;
+        }
+        uint16_t count = ktv_bytes_to_int2(&data[index]);
+        index += 2;
+        // each element needs at least its length prefix
+        if (count > (size - index) / 2)
+        {
+            return SIZE_MAX;
+        }
+        if (count == 0)
+        {
+            break;
+        }
+        if (wanted != NULL && !KTV_MASK_TEST(wanted, op->field_index))
+        {
+            for (size_t j = 0; j < count && index + 2 <= size; j++)
+            {
+                index += 2 + (uint16_t)ktv_bytes_to_int2(&data[index]);
+            }
+            break;
+        }
+        ktv_array *models = ktv_obj_reuse_array(obj, op->field_index, count);
+        for (size_t j = 0; j < count; j++)
+        {
+            // a missing element prefix decodes the element from no bytes, like a truncated nested model
+            size_t model_size = index + 2 <= size ? (uint16_t)ktv_bytes_to_int2(&data[index]) : 0;
+            index += 2;
+            if (models->objects[j] == NULL)
+            {
+                models->objects[j] = ktv_obj_new_index(obj->tree, obj->arena, op->sub_type);
+            }
+            ktv_obj_decode_bytes(models->objects[j], data + index, ktv_decode_range(index, model_size, size), mask);
+            index += model_size;
+        }
+        ktv_obj_set_array_by_index(obj, op->field_index, models);
+        break;
+    }
+    }
+    return index;
+}
+
+/**
+ * decode size bytes at data into obj
+ * nested models recurse on ranges of the same input, nothing is copied
+ * fields not in mask (nullable) are skipped by their wire size / length prefix
+ */
+void ktv_obj_decode_bytes(ktv_obj *obj, uint8_t *data, size_t size, ktv_mask *mask)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    size_t index = 0;
+    for (ktv_op *op = model->ops; op < model->ops + model->op_count && index < size; op++)
+    {
+        index = ktv_obj_decode_op(obj, op, data, index, size, mask);
+    }
+}
+
+/**
+ * decode size bytes at data, already checked by ktv_validate_bytes, into obj
+ * lengths & counts are known to fit, the only check left is where the input ends,
+ * which validation allows at any field boundary
+ */
+void ktv_obj_decode_verified_bytes(ktv_obj *obj, uint8_t *data, size_t size)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    size_t index = 0;
+    for (ktv_op *op = model->ops; op < model->ops + model->op_count && index < size; op++)
+    {
+        switch (op->code)
+        {
+        case KTV_OP_BLOCK:
+            for (size_t i = op->field_index; i < op->field_index + op->field_count && index < size; i++)
+            {
+                ktv_scalar_op *scalar = &model->scalars[i];
+                ktv_copy_scalar_in(data + index, scalar->width, obj->data + scalar->offset);
+                obj->data[i / 8] |= 1 << (i % 8);
+                index += scalar->width;
+            }
+            break;
+        case KTV_OP_ARRAY:
+        {
+            uint16_t count = ktv_bytes_to_int2(&data[index]);
+            index += 2;
+            if (count > 0)
+            {
+                ktv_array *array = ktv_obj_reuse_array(obj, op->field_index, count);
+                ktv_read_array_values(array, op->sub_type, data + index, count);
+                ktv_obj_set_array_by_index(obj, op->field_index, array);
+            }
+            index += count * op->size;
+            break;
+        }
+        case KTV_OP_MODEL:
+        {
+            uint16_t model_size = ktv_bytes_to_int2(&data[index]);
+            index += 2;
+            ktv_obj *model_obj = ktv_obj_reuse_obj(obj, op->field_index, op->sub_type);
+            ktv_obj_decode_verified_bytes(model_obj, data + index, model_size);
+            ktv_obj_set_obj_by_index(obj, op->field_index, model_obj);
+            index += model_size;
+            break;
+        }
+        case KTV_OP_MODEL_ARRAY:
+        {
+            uint16_t count = ktv_bytes_to_int2(&data[index]);
+            index += 2;
+            if (count == 0)
+            {
+                break;
+            }
+            ktv_array *models = ktv_obj_reuse_array(obj, op->field_index, count);
+            for (size_t j = 0; j < count; j++)
+            {
+                uint16_t model_size = ktv_bytes_to_int2(&data[index]);
+                index += 2;
+                if (models->objects[j] == NULL)
+                {
+                    models->objects[j] = ktv_obj_new_index(obj->tree, obj->arena, op->sub_type);
+                }
+                ktv_obj_decode_verified_bytes(models->objects[j], data + index, model_size);
+                index += model_size;
+            }
+            ktv_obj_set_array_by_index(obj, op->field_index, models);
+            break;
+        }
+        }
+    }
+}
+
+void ktv_obj_decode(ktv_obj *obj, ktv_buffer *buffer)
+{
+    if (obj == NULL || buffer == NULL)
+    {
+        return;
+    }
+    ktv_obj_decode_bytes(obj, buffer->buffer, buffer->size, NULL);
+}
+
+void ktv_parallel_read_task(void *argument, size_t slice)
+{
+    ktv_parallel_job *job = (ktv_parallel_job *)argument;
+    ktv_array *array = job->array;
+    size_t end = (slice + 1) * KTV_PARALLEL_SLICE_SIZE;
+    end = end < array->count ? end : array->count;
+    for (size_t j = slice * KTV_PARALLEL_SLICE_SIZE; j < end; j++)
+    {
+        size_t index = job->offsets[j];
+        size_t model_size = 0;
+        if (index + 2 <= job->size)
+        {
+            model_size = ktv_decode_range(index + 2, ktv_bytes_to_int2(&job->data[index]), job->size);
+        }
+        if (array->objects[j] == NULL)
+        {
+            array->objects[j] = ktv_obj_new_index(job->tree, NULL, array->sub_type);
+        }
+        ktv_obj_decode_bytes(array->objects[j], job->data + index + 2, model_size, NULL);
+    }
+}
+
+void ktv_obj_decode_parallel(ktv_obj *obj, ktv_buffer *buffer, ktv_executor executor, void *context)
+{
+    if (obj == NULL || buffer == NULL)
+    {
+        return;
+    }
+    // arenas are not thread safe, arena objects are decoded on the calling thread
+    if (executor == NULL || obj->arena != NULL)
+    {
+        ktv_obj_decode(obj, buffer);
+        return;
+    }
+    ktv_model *model = obj->tree->models[obj->model_index];
+    uint8_t *data = buffer->buffer;
+    size_t size = buffer->size;
+    size_t index = 0;
+    for (ktv_op *op = model->ops; op < model->ops + model->op_count && index < size; op++)
+    {
+        if (op->code != KTV_OP_MODEL_ARRAY || index + 2 > size ||
+            ktv_bytes_to_int2(&data[index]) < KTV_PARALLEL_MIN_COUNT)
+        {
+            index = ktv_obj_decode_op(obj, op, data, index, size, NULL);
+            continue;
+        }
+        uint16_t count = ktv_bytes_to_int2(&data[index]);
+        index += 2;
+        ktv_parallel_job job = {ktv_obj_reuse_array(obj, op->field_index, count), malloc(sizeof(size_t) * count),
+                                data, size, obj->tree};
+        // scan element length prefixes, then decode elements into their slots on the executor
+        for (size_t j = 0; j < count; j++)
+        {
+            job.offsets[j] = index;
+            index += index + 2 <= size ? 2 + (uint16_t)ktv_bytes_to_int2(&data[index]) : 2;
+        }
+        size_t slices = (count + KTV_PARALLEL_SLICE_SIZE - 1) / KTV_PARALLEL_SLICE_SIZE;
+        executor(context, ktv_parallel_read_task, &job, slices);
+        ktv_obj_set_array_by_index(obj, op->field_index, job.array);
+        free(job.offsets);
+    }
+}
+
+void ktv_obj_decode_fields(ktv_obj *obj, ktv_buffer *buffer, ktv_mask *mask)
+{
+    if (obj == NULL || buffer == NULL || mask == NULL || obj->tree != mask->tree)
+    {
+        return;
+    }
+    ktv_obj_decode_bytes(obj, buffer->buffer, buffer->size, mask);
+}
+
+/**
+ * a scalar is present once set, an array / model once its pointer is set
+ */
+int ktv_obj_has_field(ktv_obj *obj, ktv_model *model, uint8_t field_index)
+{
+    if (ktv_type_size(model->fields[field_index]->type) > 0)
+    {
+        return KTV_MASK_TEST(obj->data, field_index);
+    }
+    return *ktv_obj_slot(obj, field_index) != NULL;
+}
+
+/**
+ * sparse encoded size: presence bitmap, then present fields only, nested models sparse as well
+ */
+size_t ktv_obj_sparse_size(ktv_obj *obj)
+{
+    if (obj == NULL)
+    {
+        return 0;
+    }
+    ktv_model *model = obj->tree->models[obj->model_index];
+    size_t size = (model->field_count + 7) / 8;
+    for (size_t i = 0; i < model->field_count; i++)
+    {
+        if (!ktv_obj_has_field(obj, model, i))
+        {
+            continue;
+        }
+        ktv_field *field = model->fields[i];
+        if (field->type == KTV_TMODEL)
+        {
+            size += 2 + ktv_obj_sparse_size((ktv_obj *)*ktv_obj_slot(obj, i));
+        }
+        else if (field->type == KTV_TMODEL_ARRAY)
+        {
+            ktv_array *array_value = (ktv_array *)*ktv_obj_slot(obj, i);
+            size += 2;
+            for (size_t j = 0; j < array_value->count; j++)
+            {
+                size += 2 + ktv_obj_sparse_size(array_value->objects[j]);
+            }
+        }
+        else if (field->type == KTV_TARRAY)
+        {
+            size += ktv_field_encoded_size(field, *ktv_obj_slot(obj, i));
+        }
+        else
+        {
+            size += ktv_type_size(field->type);
+        }
+    }
+    return size;
+}
+
+/**
+ * write sparse encoded obj into dst (at least ktv_obj_sparse_size bytes)
+ * present fields use the same encoding as ktv_obj_write, nested models are length prefixed
+ * returns the end of written bytes
+ */
+uint8_t *ktv_obj_write_sparse(ktv_obj *obj, uint8_t *dst)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    uint8_t *present = dst;
+    memset(present, 0, (model->field_count + 7) / 8);
+    dst += (model->field_count + 7) / 8;
+    for (size_t i = 0; i < model->field_count; i++)
+    {
+        if (!ktv_obj_has_field(obj, model, i))
+        {
+            continue;
+        }
+        present[i / 8] |= 1 << (i % 8);
+        ktv_field *field = model->fields[i];
+        if (field->type == KTV_TMODEL)
+        {
+            uint8_t *model_start = dst + 2;
+            uint8_t *model_end = ktv_obj_write_sparse((ktv_obj *)*ktv_obj_slot(obj, i), model_start);
+            ktv_int2_to_bytes(model_end - model_start, dst);
+            dst = model_end;
+        }
+        else if (field->type == KTV_TMODEL_ARRAY)
+        {
+            ktv_array *array_value = (ktv_array *)*ktv_obj_slot(obj, i);
+            ktv_int2_to_bytes(array_value->count, dst);
+            dst += 2;
+            for (size_t j = 0; j < array_value->count; j++)
+            {
+                ktv_obj *item = array_value->objects[j];
+                uint8_t *model_start = dst + 2;
+                uint8_t *model_end = item != NULL ? ktv_obj_write_sparse(item, model_start) : model_start;
+                ktv_int2_to_bytes(model_end - model_start, dst);
+                dst = model_end;
+            }
+        }
+        else if (field->type == KTV_TARRAY)
+        {
+            dst = ktv_obj_write_field(field, *ktv_obj_slot(obj, i), dst);
+        }
+        else
+        {
+            ktv_copy_scalar_out(obj->data + model->scalars[i].offset, model->scalars[i].width, dst);
+            dst += model->scalars[i].width;
+        }
+    }
+    return dst;
+}
+
+ktv_buffer *ktv_obj_encode_sparse(ktv_obj *obj)
+{
+    if (obj == NULL)
+    {
+        return NULL;
+    }
+    size_t size = ktv_obj_sparse_size(obj);
+    ktv_buffer *buffer = ktv_buffer_new(NULL, 0);
+    ktv_buffer_reserve(buffer, size);
+    ktv_obj_write_sparse(obj, buffer->buffer);
+    buffer->size = size;
+    return buffer;
+}
+
+/**
+ * decode size bytes of sparse format at data into obj
+ * scalars & basic arrays are read by the dense codec ops, nested models recurse in sparse format
+ */
+void ktv_obj_decode_sparse_bytes(ktv_obj *obj, uint8_t *data, size_t size)
+{
+    ktv_model *model = obj->tree->models[obj->model_index];
+    size_t index = (model->field_count + 7) / 8;
+    if (size < index)
+    {
+        return;
+    }
+    for (size_t i = 0; i < model->field_count && index < size; i++)
+    {
+        if (!KTV_MASK_TEST(data, i))
+        {
+            continue;
+        }
+        ktv_field *field = model->fields[i];
+        // every length / count prefix must be inside the input, decoding stops at the first one that is not
+        if (ktv_type_size(field->type) == 0 && index + 2 > size)
+        {
+            return;
+        }
+        if (field->type == KTV_TMODEL)
+        {
+            uint16_t model_size = ktv_bytes_to_int2(&data[index]);
+            index += 2;
+            ktv_obj *model_obj = ktv_obj_reuse_obj(obj, i, field->sub_type);
+            ktv_obj_decode_sparse_bytes(model_obj, data + index, ktv_decode_range(index, model_size, size));
+            ktv_obj_set_obj_by_index(obj, i, model_obj);
+            index += model_size;
+        }
+        else if (field->type == KTV_TMODEL_ARRAY)
+        {
+            size_t count = ktv_bytes_to_int2(&data[index]);
+            index += 2;
+            // each element needs at least its length prefix
+            if (count > (size - index) / 2)
+            {
+                return;
+            }
+            if (count == 0)
+            {
+                continue;
+            }
+            ktv_array *models = ktv_obj_reuse_array(obj, i, count);
+            for (size_t j = 0; j < count; j++)
+            {
+                // a missing element prefix decodes the element from no bytes, like a truncated nested model
+                size_t model_size = 0;
+                if (index + 2 <= size)
+                {
+                    model_size = ktv_bytes_to_int2(&data[index]);
+                }
+                index += 2;
+                if (models->objects[j] == NULL)
+                {
+                    models->objects[j] = ktv_obj_new_index(obj->tree, obj->arena, field->sub_type);
+                }
+                ktv_obj_decode_sparse_bytes(models->objects[j], data + index, ktv_decode_range(index, model_size, size));
+                index += model_size;
+            }
+            ktv_obj_set_array_by_index(obj, i, models);
+        }
+        else if (field->type == KTV_TARRAY)
+        {
+            size_t count = ktv_bytes_to_int2(&data[index]);
+            if (count * ktv_type_size(field->sub_type) > size - index - 2)
+            {
+                return;
+            }
+            ktv_op op = {KTV_OP_ARRAY, i, 1, field->sub_type, ktv_type_size(field->sub_type)};
+            index = ktv_obj_decode_op(obj, &op, data, index, size, NULL);
+        }
+        else
+        {
+            size_t scalar_size = ktv_type_size(field->type);
+            if (index + scalar_size > size)
+            {
+                return;
+            }
+            ktv_op op = {KTV_OP_BLOCK, i, 1, field->sub_type, scalar_size};
+            index = ktv_obj_decode_op(obj, &op, data, index, size, NULL);
+        }
+    }
+}
+
+void ktv_obj_decode_sparse(ktv_obj *obj, ktv_buffer *buffer)
+{
+    if (obj == NULL || buffer == NULL)
+    {
+        return;
+    }
+    ktv_obj_decode_sparse_bytes(obj, buffer->buffer, buffer->size);
+}
+
+int ktv_validate_sparse_bytes(ktv_tree *tree, uint8_t model_index, uint8_t *data, size_t size)
+{
+    ktv_model *model = tree->models[model_index];
+    size_t index = (model->field_count + 7) / 8;
+    if (size == 0)
+    {
+        return 0;
+    }
+    if (size < index)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < model->field_count && index < size; i++)
+    {
+        if (!KTV_MASK_TEST(data, i))
+        {
+            continue;
+        }
+        ktv_field *field = model->fields[i];
+        size_t scalar_size = ktv_type_size(field->type);
+        if (scalar_size > 0)
+        {
+            if (index + scalar_size > size)
+            {
+                return -1;
+            }
+            index += scalar_size;
+            continue;
+        }
+        if (index + 2 > size)
+        {
+            return -1;
+        }
+        size_t count = ktv_bytes_to_int2(&data[index]);
+        index += 2;
+        if (field->type == KTV_TARRAY)
+        {
+            if (count * ktv_type_size(field->sub_type) > size - index)
+            {
+                return -1;
+            }
+            index += count * ktv_type_size(field->sub_type);
+        }
+        else if (field->type == KTV_TMODEL)
+        {
+            if (count > size - index || ktv_validate_sparse_bytes(tree, field->sub_type, data + index, count) != 0)
+            {
+                return -1;
+            }
+            index += count;
+        }
+        else
+        {
+            for (size_t j = 0; j < count; j++)
+            {
+                if (index + 2 > size)
+                {
+                    return -1;
+                }
+                uint16_t model_size = ktv_bytes_to_int2(&data[index]);
+                index += 2;
+                if (model_size > size - index ||
+                    ktv_validate_sparse_bytes(tree, field->sub_type, data + index, model_size) != 0)
+                {
+                    return -1;
+                }
+                index += model_size;
+            }
+        }
+    }
+    return 0;
+}
+
+int ktv_validate_sparse(ktv_tree *tree, const char *name, uint8_t *data, size_t size)
+{
+    uint8_t model_index = ktv_find_model_index(tree, name);
+    if (model_index == INDEX_INVALID || data == NULL)
+    {
+        return -1;
+    }
+    return ktv_validate_sparse_bytes(tree, model_index, data, size);
+}
+
+ktv_mask *ktv_mask_new(ktv_tree *tree)
+{
+    ktv_mask *mask = malloc(sizeof(ktv_mask));
+    mask->tree = tree;
+    mask->bits = calloc(tree->model_count, KTV_MASK_BYTES);
+    return mask;
+}
+
+/**
+ * select every field of a model and, recursively, of its nested models
+ * visited has one bit per model index, so recursive models are walked once per selection
+ * regardless of which fields earlier paths already selected
+ */
+void ktv_mask_add_model(ktv_mask *mask, uint8_t model_index, uint8_t *visited)
+{
+    if (KTV_MASK_TEST(visited, model_index))
+    {
+        return;
+    }
+    visited[model_index / 8] |= 1 << (model_index % 8);
+    ktv_model *model = mask->tree->models[model_index];
+    uint8_t *bits = mask->bits + model_index * KTV_MASK_BYTES;
+    for (size_t i = 0; i < model->field_count; i++)
+    {
+        bits[i / 8] |= 1 << (i % 8);
+        if (model->fields[i]->type == KTV_TMODEL || model->fields[i]->type == KTV_TMODEL_ARRAY)
+        {
+            ktv_mask_add_model(mask, model->fields[i]->sub_type, visited);
+        }
+    }
+}
+
+int ktv_mask_add(ktv_mask *mask, const char *name, const char *path)
+{
+    uint8_t model_index = ktv_find_model_index(mask->tree, name);
+    if (model_index == INDEX_INVALID)
+    {
+        return -1;
+    }
+    const char *segment = path;
+    while (1)
+    {
+        const char *end = strchr(segment, '.');
+        size_t length = end != NULL ? (size_t)(end - segment) : strlen(segment);
+        ktv_model *model = mask->tree->models[model_index];
+        ktv_field *field = NULL;
+        size_t i = 0;
+        for (; i < model->field_count; i++)
+        {
+            if (strncmp(model->fields[i]->alias, segment, length) == 0 && model->fields[i]->alias[length] == '\0')
+            {
+                field = model->fields[i];
+                break;
+            }
+        }
+        if (field == NULL)
+        {
+            return -1;
+        }
+        uint8_t *bits = mask->bits + model_index * KTV_MASK_BYTES;
+        int nested = field->type == KTV_TMODEL || field->type == KTV_TMODEL_ARRAY;
+        if (end == NULL)
+        {
+            bits[i / 8] |= 1 << (i % 8);
+            if (nested)
+            {
+                uint8_t visited[KTV_MASK_BYTES] = {0};
+                ktv_mask_add_model(mask, field->sub_type, visited);
+            }
+            return 0;
+        }
+        if (!nested)
+        {
+            return -1;
+        }
+        bits[i / 8] |= 1 << (i % 8);
+        model_index = field->sub_type;
+        segment = end + 1;
+    }
+}
+
+void ktv_mask_delete(ktv_mask *mask)
+{
+    if (mask == NULL)
+    {
+        return;
+    }
+    free(mask->bits);
+    free(mask);
+}
+
+/**
+ * check that size bytes at data are a well formed model, recursing into nested models
+ * input may end at any field boundary, like ktv_obj_decode allows
+ * returns 0 if valid, -1 otherwise
+ */
+int ktv_validate_bytes(ktv_tree *tree, uint8_t model_index, uint8_t *data, size_t size)
+{
+    ktv_model *model = tree->models[model_index];
+    size_t index = 0;
+    for (ktv_op *op = model->ops; op < model->ops + model->op_count && index < size; op++)
+    {
+        if (op->code == KTV_OP_BLOCK)
+        {
+            if (index + op->size <= size)
+            {
+                index += op->size;
+                continue;
+            }
+            for (size_t i = op->field_index; i < op->field_index + op->field_count && index < size; i++)
+            {
+                index += ktv_type_size(model->fields[i]->type);
+            }
+            return index == size ? 0 : -1;
+        }
+        if (index + 2 > size)
+        {
+            return -1;
+        }
+        uint16_t count = ktv_bytes_to_int2(&data[index]);
+        index += 2;
+        if (op->code == KTV_OP_ARRAY)
+        {
+            if ((size_t)count * op->size > size - index)
+            {
+                return -1;
+            }
+            index += (size_t)count * op->size;
+        }
+        else if (op->code == KTV_OP_MODEL)
+        {
+            if (count > size - index || ktv_validate_bytes(tree, op->sub_type, data + index, count) != 0)
+            {
+                return -1;
+            }
+            index += count;
+        }
+        else
+        {
+            for (size_t j = 0; j < count; j++)
+            {
+                if (index + 2 > size)
+                {
+                    return -1;
+                }
+                uint16_t model_size = ktv_bytes_to_int2(&data[index]);
+                index += 2;
+                if (model_size > size - index ||
+                    ktv_validate_bytes(tree, op->sub_type, data + index, model_size) != 0)
+                {
+                    return -1;
+                }
+                index += model_size;
+            }
+        }
+    }
+    return 0;
+}
+
+int ktv_validate(ktv_tree *tree, const char *name, uint8_t *data, size_t size, ktv_verified *verified)
+{
+    uint8_t model_index = ktv_find_model_index(tree, name);
+    if (model_index == INDEX_INVALID || data == NULL || ktv_validate_bytes(tree, model_index, data, size) != 0)
+    {
+        return -1;
+    }
+    verified->tree = tree;
+    verified->model_index = model_index;
+    verified->data = data;
+    verified->size = size;
+    return 0;
+}
+
+void ktv_obj_decode_verified(ktv_obj *obj, ktv_verified *verified)
+{
+    if (obj == NULL || verified == NULL || obj->tree != verified->tree || obj->model_index != verified->model_index)
+    {
+        return;
+    }
+    ktv_obj_decode_verified_bytes(obj, verified->data, verified->size);
+}
+
+ktv_view ktv_view_new(ktv_tree *tree, const char *name, const uint8_t *data, size_t size)
+{
+    ktv_view view = {tree, ktv_find_model_index(tree, name), data, size};
+    if (view.model_index == INDEX_INVALID)
+    {
+        view.data = NULL;
+        view.size = 0;
+    }
+    return view;
+}
+
+/**
+ * offset of a field inside view data, or SIZE_MAX if the field is not there
+ * earlier fields are skipped by their length / count prefixes without being parsed
+ */
+size_t ktv_view_locate(ktv_view *view, uint8_t field_index)
+{
+    if (view->data == NULL || view->model_index == INDEX_INVALID)
+    {
+        return SIZE_MAX;
+    }
+    ktv_model *model = view->tree->models[view->model_index];
+    const uint8_t *data = view->data;
+    size_t index = 0;
+    for (ktv_op *op = model->ops; op < model->ops + model->op_count; op++)
+    {
+        if (op->code == KTV_OP_BLOCK && field_index < op->field_index + op->field_count)
+        {
+            for (size_t i = op->field_index; i < field_index; i++)
+            {
+                index += ktv_type_size(model->fields[i]->type);
+            }
+            break;
+        }
+        if (op->field_index == field_index)
+        {
+            break;
+        }
+        if (op->code == KTV_OP_BLOCK)
+        {
+            index += op->size;
+            continue;
+        }
+        if (index + 2 > view->size)
+        {
+            return SIZE_MAX;
+        }
+        uint16_t length = ktv_bytes_to_int2((uint8_t *)data + index);
+        index += 2;
+        if (op->code == KTV_OP_ARRAY)
+        {
+            index += length * op->size;
+        }
+        else if (op->code == KTV_OP_MODEL)
+        {
+            index += length;
+        }
+        else
+        {
+            for (size_t j = 0; j < length && index + 2 <= view->size; j++)
+            {
+                index += 2 + (uint16_t)ktv_bytes_to_int2((uint8_t *)data + index);
+            }
+        }
+    }
+    return index < view->size ? index : SIZE_MAX;
+}
+
+/**
+ * field bytes of given type, or NULL if the field is missing or truncated
+ */
+const uint8_t *ktv_view_field(ktv_view *view, const char *alias, uint8_t type, size_t size)
+{
+    if (view->data == NULL || view->model_index == INDEX_INVALID)
+    {
+        return NULL;
+    }
+    uint8_t field_index = ktv_find_model_field_index(view->tree->models[view->model_index], alias, type);
+    if (field_index == INDEX_INVALID)
+    {
+        return NULL;
+    }
+    size_t index = ktv_view_locate(view, field_index);
+    if (index == SIZE_MAX || index + size > view->size)
+    {
+        return NULL;
+    }
+    return view->data + index;
+}
+
+char ktv_view_get_char(ktv_view *view, const char *alias)
+{
+    const uint8_t *data = ktv_view_field(view, alias, KTV_TCHAR, 1);
+    return data != NULL ? (char)data[0] : 0;
+}
+
+int8_t ktv_view_get_byte(ktv_view *view, const char *alias)
+{
+    const uint8_t *data = ktv_view_field(view, alias, KTV_TBYTE, 1);
+    return data != NULL ? (int8_t)data[0] : 0;
+}
+
+int16_t ktv_view_get_int2(ktv_view *view, const char *alias)
+{
+    const uint8_t *data = ktv_view_field(view, alias, KTV_TINT2, 2);
+    return data != NULL ? ktv_bytes_to_int2((uint8_t *)data) : 0;
 }
 
-ktv_obj *ktv_obj_get_obj(ktv_obj *obj, const char *alias)
+int32_t ktv_view_get_int4(ktv_view *view, const char *alias)
 {
-    void *value = ktv_obj_get_value_ptr(obj, alias, KTV_TMODEL);
-    return (ktv_obj *)value;
+    const uint8_t *data = ktv_view_field(view, alias, KTV_TINT4, 4);
+    return data != NULL ? ktv_bytes_to_int4((uint8_t *)data) : 0;
 }
 
-void ktv_obj_set_array(ktv_obj *obj, const char *alias, ktv_array *value)
+/**
+ * element bytes of a basic type array, or NULL if array is missing / empty / truncated
+ */
+const uint8_t *ktv_view_array(ktv_view *view, const char *alias, uint8_t sub_type, uint16_t *count)
 {
-    uint8_t field_index = ktv_find_field_index(obj, alias, value->type);
-    if (field_index == INDEX_INVALID)
+    *count = 0;
+    const uint8_t *data = ktv_view_field(view, alias, KTV_TARRAY, 2);
+    if (data == NULL)
     {
-        return;
+        return NULL;
     }
-    ktv_model *model = obj->tree->models[obj->model_index];
-    ktv_field *field = model->fields[field_index];
-    if (field->type != value->type || field->sub_type != value->sub_type)
+    ktv_model *model = view->tree->models[view->model_index];
+    uint16_t length = ktv_bytes_to_int2((uint8_t *)data);
+    size_t size = length * ktv_type_size(sub_type);
+    if (model->fields[ktv_find_model_field_index(model, alias, KTV_TARRAY)]->sub_type != sub_type ||
+        length == 0 || (size_t)(data + 2 - view->data) + size > view->size)
     {
-        return;
+        return NULL;
     }
-    // todo: delete replaced array?
-    obj->values[field_index] = value;
+    *count = length;
+    return data + 2;
 }
 
-ktv_array *ktv_obj_get_array(ktv_obj *obj, const char *alias)
+uint16_t ktv_view_get_count(ktv_view *view, const char *alias)
 {
-    void *value = ktv_obj_get_value_ptr(obj, alias, KTV_TARRAY);
-    if (value == NULL)
+    const uint8_t *data = ktv_view_field(view, alias, KTV_TARRAY, 2);
+    if (data == NULL)
     {
-        value = ktv_obj_get_value_ptr(obj, alias, KTV_TMODEL_ARRAY);
+        data = ktv_view_field(view, alias, KTV_TMODEL_ARRAY, 2);
     }
-    return (ktv_array *)value;
+    return data != NULL ? ktv_bytes_to_int2((uint8_t *)data) : 0;
 }
 
-ktv_array *ktv_array_new_string(ktv_obj *obj, const char *alias, char *values, uint16_t count)
+const char *ktv_view_get_string(ktv_view *view, const char *alias, uint16_t *count)
 {
-    ktv_array *array = ktv_array_new_basic(obj, alias, count);
-    array->values = malloc(sizeof(char) * count);
-    for (size_t i = 0; i < count; i++)
-    {
-        ((char *)array->values)[i] = values[i];
-    }
-    return array;
+    return (const char *)ktv_view_array(view, alias, KTV_TCHAR, count);
 }
 
-ktv_array *ktv_array_new_bytes(ktv_obj *obj, const char *alias, int8_t *values, uint16_t count)
+const int8_t *ktv_view_get_bytes(ktv_view *view, const char *alias, uint16_t *count)
 {
-    ktv_array *array = ktv_array_new_basic(obj, alias, count);
-    array->values = malloc(sizeof(int8_t) * count);
-    for (size_t i = 0; i < count; i++)
-    {
-        ((int8_t *)array->values)[i] = values[i];
-    }
-    return array;
+    return (const int8_t *)ktv_view_array(view, alias, KTV_TBYTE, count);
 }
 
-ktv_array *ktv_array_new_int2s(ktv_obj *obj, const char *alias, int16_t *values, uint16_t count)
+int16_t ktv_view_get_int2_at(ktv_view *view, const char *alias, uint16_t index)
 {
-    ktv_array *array = ktv_array_new_basic(obj, alias, count);
-    array->values = malloc(sizeof(int16_t) * count);
-    for (size_t i = 0; i < count; i++)
+    uint16_t count = 0;
+    const uint8_t *data = ktv_view_array(view, alias, KTV_TINT2, &count);
+    return index < count ? ktv_bytes_to_int2((uint8_t *)data + index * 2) : 0;
+}
+
+int32_t ktv_view_get_int4_at(ktv_view *view, const char *alias, uint16_t index)
+{
+    uint16_t count = 0;
+    const uint8_t *data = ktv_view_array(view, alias, KTV_TINT4, &count);
+    return index < count ? ktv_bytes_to_int4((uint8_t *)data + index * 4) : 0;
+}
+
+/**
+ * nested view over length prefixed model bytes at data, empty if truncated
+ */
+ktv_view ktv_view_nested(ktv_view *view, uint8_t model_index, const uint8_t *data)
+{
+    ktv_view nested = {view->tree, model_index, NULL, 0};
+    if (data == NULL || (size_t)(data - view->data) + 2 > view->size)
     {
-        ((int16_t *)array->values)[i] = values[i];
+        return nested;
     }
-    return array;
+    uint16_t length = ktv_bytes_to_int2((uint8_t *)data);
+    if ((size_t)(data + 2 - view->data) + length <= view->size)
+    {
+        nested.data = data + 2;
+        nested.size = length;
+    }
+    return nested;
 }
 
-ktv_array *ktv_array_new_int4s(ktv_obj *obj, const char *alias, int32_t *values, uint16_t count)
+ktv_view ktv_view_get_obj(ktv_view *view, const char *alias)
 {
-    ktv_array *array = ktv_array_new_basic(obj, alias, count);
-    array->values = malloc(sizeof(int32_t) * count);
-    for (size_t i = 0; i < count; i++)
+    ktv_view nested = {view->tree, INDEX_INVALID, NULL, 0};
+    const uint8_t *data = ktv_view_field(view, alias, KTV_TMODEL, 2);
+    if (data == NULL)
     {
-        ((int32_t *)array->values)[i] = values[i];
+        return nested;
     }
-    return array;
+    ktv_model *model = view->tree->models[view->model_index];
+    uint8_t model_index = model->fields[ktv_find_model_field_index(model, alias, KTV_TMODEL)]->sub_type;
+    return ktv_view_nested(view, model_index, data);
 }
 
-ktv_array *ktv_array_new_objs(ktv_obj *obj, const char *alias, uint16_t capacity)
+ktv_view ktv_view_get_obj_at(ktv_view *view, const char *alias, uint16_t index)
 {
-    uint8_t field_index = ktv_find_field_index(obj, alias, KTV_TMODEL_ARRAY);
-    if (field_index == INDEX_INVALID || capacity == 0)
+    ktv_view nested = {view->tree, INDEX_INVALID, NULL, 0};
+    const uint8_t *data = ktv_view_field(view, alias, KTV_TMODEL_ARRAY, 2);
+    if (data == NULL || index >= ktv_bytes_to_int2((uint8_t *)data))
     {
-        return NULL;
+        return nested;
     }
-    ktv_field *field = obj->tree->models[obj->model_index]->fields[field_index];
-    ktv_array *array = malloc(sizeof(ktv_array));
-    array->type = field->type;
-    array->sub_type = field->sub_type;
-    array->values = NULL;
-    array->count = capacity;
-    array->objects = malloc(sizeof(ktv_obj *) * capacity);
-    for (size_t i = 0; i < capacity; i++)
+    ktv_model *model = view->tree->models[view->model_index];
+    uint8_t model_index = model->fields[ktv_find_model_field_index(model, alias, KTV_TMODEL_ARRAY)]->sub_type;
+    data += 2;
+    for (size_t j = 0; j < index; j++)
     {
-        array->objects[i] = NULL;
+        if ((size_t)(data - view->data) + 2 > view->size)
+        {
+            return nested;
+        }
+        data += 2 + (uint16_t)ktv_bytes_to_int2((uint8_t *)data);
     }
-
-    return array;
+    return ktv_view_nested(view, model_index, data);
 }
 
-void ktv_array_delete(ktv_array *array)
+ktv_array_index *ktv_array_index_new(ktv_view *view, const char *alias)
 {
-    if (array == NULL)
+    const uint8_t *data = ktv_view_field(view, alias, KTV_TMODEL_ARRAY, 2);
+    if (data == NULL)
     {
-        return;
+        return NULL;
     }
-    if (array->type == KTV_TARRAY)
+    ktv_model *model = view->tree->models[view->model_index];
+    ktv_array_index *array_index = malloc(sizeof(ktv_array_index));
+    array_index->tree = view->tree;
+    array_index->model_index = model->fields[ktv_find_model_field_index(model, alias, KTV_TMODEL_ARRAY)]->sub_type;
+    array_index->data = view->data;
+    array_index->count = 0;
+    uint16_t count = ktv_bytes_to_int2((uint8_t *)data);
+    array_index->offsets = malloc(sizeof(size_t) * (count > 0 ? count : 1));
+    size_t index = data + 2 - view->data;
+    // elements truncated by the end of view are left out of the index
+    for (size_t j = 0; j < count && index + 2 <= view->size; j++)
     {
-        if (array->values != NULL)
+        size_t next = index + 2 + (uint16_t)ktv_bytes_to_int2((uint8_t *)view->data + index);
+        if (next > view->size)
         {
-            free(array->values);
+            break;
         }
-        free(array);
-        return;
+        array_index->offsets[array_index->count++] = index;
+        index = next;
     }
-    for (size_t i = 0; i < array->count; i++)
+    return array_index;
+}
+
+ktv_view ktv_array_index_view(ktv_array_index *array_index, uint16_t index)
+{
+    ktv_view view = {array_index->tree, array_index->model_index, NULL, 0};
+    if (index < array_index->count)
     {
-        if (array->objects[i] != NULL)
-        {
-            ktv_obj_delete(array->objects[i]);
-        }
+        const uint8_t *data = array_index->data + array_index->offsets[index];
+        view.data = data + 2;
+        view.size = (uint16_t)ktv_bytes_to_int2((uint8_t *)data);
     }
-    free(array->objects);
-    free(array);
+    return view;
 }
 
-char *ktv_array_get_string(ktv_array *array)
+ktv_obj *ktv_array_index_decode(ktv_array_index *array_index, uint16_t index)
 {
-    return (char *)array->values;
+    if (index >= array_index->count)
+    {
+        return NULL;
+    }
+    ktv_view view = ktv_array_index_view(array_index, index);
+    ktv_obj *obj = ktv_obj_new_index(array_index->tree, NULL, array_index->model_index);
+    ktv_obj_decode_bytes(obj, (uint8_t *)view.data, view.size, NULL);
+    return obj;
 }
 
-int8_t *ktv_array_get_bytes(ktv_array *array)
+uint16_t ktv_array_index_decode_range(ktv_array_index *array_index, uint16_t first, uint16_t count, ktv_obj **objs)
 {
-    return (int8_t *)array->values;
+    uint16_t decoded = 0;
+    for (size_t j = first; j < (size_t)first + count && j < array_index->count; j++)
+    {
+        objs[decoded++] = ktv_array_index_decode(array_index, j);
+    }
+    return decoded;
 }
 
-int16_t *ktv_array_get_int2s(ktv_array *array)
+void ktv_array_index_delete(ktv_array_index *array_index)
 {
-    return (int16_t *)array->values;
+    if (array_index == NULL)
+    {
+        return;
+    }
+    free(array_index->offsets);
+    free(array_index);
 }
 
-int32_t *ktv_array_get_int4s(ktv_array *array)
+ktv_decoder *ktv_decoder_new(ktv_tree *tree, const char *name)
 {
-    return (int32_t *)array->values;
+    uint8_t model_index = ktv_find_model_index(tree, name);
+    if (model_index == INDEX_INVALID)
+    {
+        return NULL;
+    }
+    ktv_decoder *decoder = malloc(sizeof(ktv_decoder));
+    decoder->tree = tree;
+    decoder->model_index = model_index;
+    decoder->depth = 0;
+    decoder->capacity = 8;
+    decoder->frames = malloc(sizeof(ktv_decoder_frame) * decoder->capacity);
+    decoder->position = 0;
+    decoder->pending_size = 0;
+    decoder->done = NULL;
+    return decoder;
 }
 
-ktv_obj *ktv_array_get_obj(ktv_array *array, uint16_t index)
+void ktv_decoder_push(ktv_decoder *decoder, ktv_obj *obj, size_t end)
+{
+    if (decoder->depth == decoder->capacity)
+    {
+        decoder->capacity *= 2;
+        decoder->frames = realloc(decoder->frames, sizeof(ktv_decoder_frame) * decoder->capacity);
+    }
+    ktv_decoder_frame *frame = &decoder->frames[decoder->depth++];
+    frame->obj = obj;
+    frame->end = end;
+    frame->op_index = 0;
+    frame->field_index = 0;
+    frame->stage = 0;
+    frame->count = 0;
+    frame->element = 0;
+    frame->array = NULL;
+    frame->copied = 0;
+}
+
+/**
+ * n bytes of a scalar or prefix, read in place when the chunk has them all,
+ * otherwise gathered in pending across feeds; NULL until all n bytes arrived
+ */
+const uint8_t *ktv_decoder_read(ktv_decoder *decoder, const uint8_t *data, size_t size, size_t *consumed, size_t n)
 {
-    if (index > array->count)
+    if (decoder->pending_size == 0 && size - *consumed >= n)
+    {
+        const uint8_t *bytes = data + *consumed;
+        *consumed += n;
+        decoder->position += n;
+        return bytes;
+    }
+    size_t copy = n - decoder->pending_size;
+    copy = copy < size - *consumed ? copy : size - *consumed;
+    memcpy(decoder->pending + decoder->pending_size, data + *consumed, copy);
+    decoder->pending_size += copy;
+    *consumed += copy;
+    decoder->position += copy;
+    if (decoder->pending_size < n)
     {
         return NULL;
     }
-    return array->objects[index];
+    decoder->pending_size = 0;
+    return decoder->pending;
 }
 
-void ktv_array_set_obj(ktv_array *array, uint16_t index, ktv_obj *obj)
+/**
+ * release the basic array still being filled by frame, if any
+ */
+void ktv_decoder_drop_partial(ktv_decoder *decoder, ktv_decoder_frame *frame)
 {
-    if (index > array->count)
+    ktv_model *model = decoder->tree->models[frame->obj->model_index];
+    if (frame->op_index >= model->op_count || frame->stage == 0)
     {
         return;
     }
-    array->objects[index] = obj;
+    if (model->ops[frame->op_index].code == KTV_OP_ARRAY)
+    {
+        ktv_array_delete(frame->array);
+    }
+    else if (model->ops[frame->op_index].code == KTV_OP_MODEL_ARRAY)
+    {
+        // elements not created yet are cut off
+        frame->array->count = frame->element;
+    }
+    frame->array = NULL;
+    frame->stage = 0;
 }
 
-ktv_buffer *ktv_obj_encode(ktv_obj *obj)
+/**
+ * malformed nested length, keep what frame decoded so far and skip to its end
+ */
+void ktv_decoder_stop(ktv_decoder *decoder, ktv_decoder_frame *frame)
 {
-    if (obj == NULL)
+    ktv_decoder_drop_partial(decoder, frame);
+    frame->op_index = decoder->tree->models[frame->obj->model_index]->op_count;
+}
+
+size_t ktv_decoder_feed(ktv_decoder *decoder, const uint8_t *data, size_t size)
+{
+    if (decoder == NULL || decoder->done != NULL)
     {
-        return NULL;
+        return 0;
     }
-    ktv_buffer *buffer = ktv_buffer_new(NULL, 0);
-    ktv_model *model = obj->tree->models[obj->model_index];
-    uint8_t field_count = model->field_count;
-    for (size_t i = 0; i < field_count; i++)
+    if (decoder->depth == 0)
     {
-        ktv_field *field = model->fields[i];
-        void *value = obj->values[i];
-        if (field->type == KTV_TCHAR)
+        if (size == 0)
         {
-            uint8_t data[1] = {*(char *)value >> 0};
-            ktv_buffer_append(buffer, data, 1);
+            return 0;
         }
-        else if (field->type == KTV_TBYTE)
+        ktv_decoder_push(decoder, ktv_obj_new_index(decoder->tree, NULL, decoder->model_index), SIZE_MAX);
+        decoder->position = 0;
+    }
+    size_t consumed = 0;
+    while (decoder->depth > 0)
+    {
+        ktv_decoder_frame *frame = &decoder->frames[decoder->depth - 1];
+        ktv_model *model = decoder->tree->models[frame->obj->model_index];
+        if (decoder->position == frame->end || frame->op_index == model->op_count)
         {
-            uint8_t data[1] = {*(int8_t *)value >> 0};
-            ktv_buffer_append(buffer, data, 1);
+            // skip bytes left in a nested model after its last field
+            if (frame->end != SIZE_MAX && decoder->position < frame->end)
+            {
+                size_t skip = frame->end - decoder->position;
+                skip = skip < size - consumed ? skip : size - consumed;
+                consumed += skip;
+                decoder->position += skip;
+                if (decoder->position < frame->end)
+                {
+                    break;
+                }
+            }
+            ktv_decoder_drop_partial(decoder, frame);
+            decoder->depth--;
+            if (decoder->depth == 0)
+            {
+                decoder->done = frame->obj;
+            }
+            continue;
         }
-        else if (field->type == KTV_TINT2)
+        ktv_op *op = &model->ops[frame->op_index];
+        if (frame->stage == 1 && op->code == KTV_OP_MODEL_ARRAY && frame->element == frame->count)
         {
-            uint8_t data[2] = {*(int16_t *)value >> 8,
-                               *(int16_t *)value >> 0};
-            ktv_buffer_append(buffer, data, 2);
+            frame->array = NULL;
+            frame->stage = 0;
+            frame->op_index++;
+            continue;
         }
-        else if (field->type == KTV_TINT4)
+        if (consumed == size)
         {
-            uint8_t data[4] = {*(int32_t *)value >> 24,
-                               *(int32_t *)value >> 16,
-                               *(int32_t *)value >> 8,
-                               *(int32_t *)value >> 0};
-            ktv_buffer_append(buffer, data, 4);
+            break;
         }
-        else if (field->type == KTV_TMODEL)
+        if (op->code == KTV_OP_BLOCK)
         {
-            ktv_buffer *model_buffer = ktv_obj_encode((ktv_obj *)value);
-            uint8_t model_length[2] = {0, 0};
-            if (model_buffer != NULL)
+            uint8_t field_index = op->field_index + frame->field_index;
+            uint8_t type = model->fields[field_index]->type;
+            size_t type_size = ktv_type_size(type);
+            if (decoder->position - decoder->pending_size + type_size > frame->end)
             {
-                model_length[0] = (uint16_t)model_buffer->size >> 8;
-                model_length[1] = (uint16_t)model_buffer->size >> 0;
-                ktv_buffer_append(buffer, model_length, 2);
-                ktv_buffer_append(buffer, model_buffer->buffer, model_buffer->size);
-                ktv_buffer_delete(model_buffer);
+                ktv_decoder_stop(decoder, frame);
+                continue;
             }
-            else
+            const uint8_t *bytes = ktv_decoder_read(decoder, data, size, &consumed, type_size);
+            if (bytes == NULL)
             {
-                ktv_buffer_append(buffer, model_length, 2);
+                break;
             }
-        }
-        else if (field->type == KTV_TARRAY)
-        {
-            uint8_t array_count[2] = {0, 0};
-            ktv_array *array_value = (ktv_array *)value;
-            if (array_value != NULL)
+            if (type == KTV_TCHAR)
             {
-                array_count[0] = array_value->count >> 8;
-                array_count[1] = array_value->count >> 0;
-                ktv_buffer_append(buffer, array_count, 2);
-                for (size_t j = 0; j < array_value->count; j++)
-                {
-                    if (field->sub_type == KTV_TBYTE || field->sub_type == KTV_TCHAR)
-                    {
-                        ktv_buffer_append(buffer, ((uint8_t *)array_value->values) + j, 1);
-                    }
-                    else if (field->sub_type == KTV_TINT2)
-                    {
-                        int16_t int2_value = ((int64_t *)array_value->values)[j];
-                        uint8_t data[2] = {int2_value >> 8, int2_value >> 0};
-                        ktv_buffer_append(buffer, data, 2);
-                    }
-                    else if (field->sub_type == KTV_TINT4)
-                    {
-                        int32_t int4_value = ((int32_t *)array_value->values)[j];
-                        uint8_t data[4] = {int4_value >> 24,
-                                           int4_value >> 16,
-                                           int4_value >> 8,
-                                           int4_value >> 0};
-                        ktv_buffer_append(buffer, data, 4);
-                    }
-                }
+                ktv_obj_set_char_by_index(frame->obj, field_index, bytes[0]);
+            }
+            else if (type == KTV_TBYTE)
+            {
+                ktv_obj_set_byte_by_index(frame->obj, field_index, bytes[0]);
+            }
+            else if (type == KTV_TINT2)
+            {
+                ktv_obj_set_int2_by_index(frame->obj, field_index, ktv_bytes_to_int2((uint8_t *)bytes));
             }
             else
             {
-                ktv_buffer_append(buffer, array_count, 2);
+                ktv_obj_set_int4_by_index(frame->obj, field_index, ktv_bytes_to_int4((uint8_t *)bytes));
+            }
+            if (++frame->field_index == op->field_count)
+            {
+                frame->op_index++;
+                frame->field_index = 0;
             }
+            continue;
         }
-        else if (field->type == KTV_TMODEL_ARRAY)
+        if (frame->stage == 1 && op->code == KTV_OP_ARRAY)
         {
-            ktv_array *array_value = (ktv_array *)value;
-            ktv_buffer *array_buffer = ktv_buffer_new(NULL, 0);
-            for (size_t i = 0; array_value != NULL && i < array_value->count; i++)
+            // array payload, copied as it arrives and converted once complete
+            size_t total = frame->array->count * op->size;
+            size_t copy = total - frame->copied;
+            copy = copy < size - consumed ? copy : size - consumed;
+            memcpy((uint8_t *)frame->array->values + frame->copied, data + consumed, copy);
+            frame->copied += copy;
+            consumed += copy;
+            decoder->position += copy;
+            if (frame->copied < total)
             {
-                uint8_t model_length[2] = {0, 0};
-                ktv_buffer *model_buffer = ktv_obj_encode(array_value->objects[i]);
-                if (model_buffer != NULL)
-                {
-                    model_length[0] = (uint16_t)model_buffer->size >> 8;
-                    model_length[1] = (uint16_t)model_buffer->size >> 0;
-                    ktv_buffer_append(array_buffer, model_length, 2);
-                    ktv_buffer_append(array_buffer, model_buffer->buffer, model_buffer->size);
-                    ktv_buffer_delete(model_buffer);
-                }
-                else
-                {
-                    ktv_buffer_append(array_buffer, model_length, 2);
-                }
+                break;
             }
-            uint8_t array_count[2] = {0, 0};
-            if (array_buffer->size > 0)
+            if (op->sub_type == KTV_TINT2)
             {
-                array_count[0] = (uint16_t)array_value->count >> 8;
-                array_count[1] = (uint16_t)array_value->count >> 0;
-                ktv_buffer_append(buffer, array_count, 2);
-                ktv_buffer_append(buffer, array_buffer->buffer, array_buffer->size);
+                ktv_bytes_to_int2s(frame->array->values, (int16_t *)frame->array->values, frame->array->count);
             }
-            else
+            else if (op->sub_type == KTV_TINT4)
             {
-                ktv_buffer_append(buffer, array_count, 2);
+                ktv_bytes_to_int4s(frame->array->values, (int32_t *)frame->array->values, frame->array->count);
             }
-            ktv_buffer_delete(array_buffer);
-        }
-    }
-    return buffer;
-}
-
-void ktv_obj_decode(ktv_obj *obj, ktv_buffer *buffer)
-{
-    if (obj == NULL || buffer == NULL || buffer->size == 0)
-    {
-        return;
-    }
-    ktv_model *model = obj->tree->models[obj->model_index];
-    uint8_t field_count = model->field_count;
-    size_t index = 0;
-    for (size_t i = 0; i < field_count && index < buffer->size; i++)
-    {
-        ktv_field *field = model->fields[i];
-        if (field->type == KTV_TCHAR)
-        {
-            char value = buffer->buffer[index];
-            ktv_obj_set_char(obj, field->alias, value);
-            index++;
-        }
-        else if (field->type == KTV_TBYTE)
-        {
-            int8_t value = buffer->buffer[index];
-            ktv_obj_set_byte(obj, field->alias, value);
-            index++;
+            ktv_obj_set_array_by_index(frame->obj, op->field_index, frame->array);
+            frame->array = NULL;
+            frame->stage = 0;
+            frame->op_index++;
+            continue;
         }
-        else if (field->type == KTV_TINT2)
+        // length / count prefix
+        if (decoder->position - decoder->pending_size + 2 > frame->end)
         {
-            int16_t value = ktv_bytes_to_int2(&buffer->buffer[index]);
-            ktv_obj_set_int2(obj, field->alias, value);
-            index += 2;
+            ktv_decoder_stop(decoder, frame);
+            continue;
         }
-        else if (field->type == KTV_TINT4)
+        const uint8_t *bytes = ktv_decoder_read(decoder, data, size, &consumed, 2);
+        if (bytes == NULL)
         {
-            int32_t value = ktv_bytes_to_int4(&buffer->buffer[index]);
-            ktv_obj_set_int4(obj, field->alias, value);
-            index += 4;
+            break;
         }
-        else if (field->type == KTV_TARRAY)
+        uint16_t length = ktv_bytes_to_int2((uint8_t *)bytes);
+        if (op->code == KTV_OP_ARRAY)
         {
-            uint16_t count = ktv_bytes_to_int2(&buffer->buffer[index]);
-            index += 2;
-            if (count == 0)
+            if (decoder->position + (size_t)length * op->size > frame->end)
             {
+                ktv_decoder_stop(decoder, frame);
                 continue;
             }
-            if (field->sub_type == KTV_TCHAR)
-            {
-                char data[count];
-                for (size_t j = 0; j < count; j++)
-                    data[j] = buffer->buffer[index + j];
-                ktv_obj_set_array(obj, field->alias, ktv_array_new_string(obj, field->alias, data, count));
-                index += count;
-            }
-            else if (field->sub_type == KTV_TBYTE)
-            {
-                int8_t data[count];
-                for (size_t j = 0; j < count; j++)
-                    data[j] = buffer->buffer[index + j];
-                ktv_obj_set_array(obj, field->alias, ktv_array_new_bytes(obj, field->alias, data, count));
-                index += count;
-            }
-            else if (field->sub_type == KTV_TINT2)
+            if (length == 0)
             {
-                int16_t data[count];
-                for (size_t j = 0; j < count; j++)
-                {
-                    data[j] = ktv_bytes_to_int2(buffer->buffer + index + j * 2);
-                }
-                ktv_obj_set_array(obj, field->alias, ktv_array_new_int2s(obj, field->alias, data, count));
-                index += count * 2;
+                frame->op_index++;
+                continue;
             }
-            else if (field->sub_type == KTV_TINT4)
+            frame->array = ktv_array_new_basic_index(frame->obj, op->field_index, length);
+            frame->array->values = ktv_obj_alloc(frame->obj->arena, op->size * length);
+            frame->copied = 0;
+            frame->stage = 1;
+        }
+        else if (frame->stage == 0 && op->code == KTV_OP_MODEL_ARRAY)
+        {
+            if (length == 0)
             {
-                int32_t data[count];
-                for (size_t j = 0; j < count; j++)
-                    data[j] = ktv_bytes_to_int4(buffer->buffer + index + j * 4);
-                ktv_obj_set_array(obj, field->alias, ktv_array_new_int4s(obj, field->alias, data, count));
-                index += count * 4;
+                frame->op_index++;
+                continue;
             }
+            frame->array = ktv_array_new_objs_index(frame->obj, op->field_index, length);
+            ktv_obj_set_array_by_index(frame->obj, op->field_index, frame->array);
+            frame->count = length;
+            frame->element = 0;
+            frame->stage = 1;
         }
-        else if (field->type == KTV_TMODEL)
+        else if (decoder->position + length > frame->end)
         {
-            uint16_t size = ktv_bytes_to_int2(&buffer->buffer[index]);
-            index += 2;
-            ktv_buffer *model_buffer = ktv_buffer_new(buffer->buffer + index, size);
-            ktv_obj *model_obj = ktv_obj_new(obj->tree, obj->tree->models[field->sub_type]->name);
-            ktv_obj_decode(model_obj, model_buffer);
-            ktv_obj_set_obj(obj, field->alias, model_obj);
-            ktv_buffer_delete(model_buffer);
-            index += size;
+            ktv_decoder_stop(decoder, frame);
         }
-        else if (field->type == KTV_TMODEL_ARRAY)
+        else
         {
-            uint16_t count = ktv_bytes_to_int2(&buffer->buffer[index]);
-            index += 2;
-            if (count == 0)
+            ktv_obj *child = ktv_obj_new_index(decoder->tree, frame->obj->arena, op->sub_type);
+            if (op->code == KTV_OP_MODEL)
             {
-                continue;
+                ktv_obj_set_obj_by_index(frame->obj, op->field_index, child);
+                frame->op_index++;
             }
-            ktv_array *models = ktv_array_new_objs(obj, field->alias, count);
-            for (size_t j = 0; j < count; j++)
+            else
             {
-                uint16_t model_size = ktv_bytes_to_int2(&buffer->buffer[index]);
-                index += 2;
-                ktv_buffer *model_buffer = ktv_buffer_new(buffer->buffer + index, model_size);
-                ktv_obj *model_obj = ktv_obj_new(obj->tree, obj->tree->models[field->sub_type]->name);
-                ktv_obj_decode(model_obj, model_buffer);
-                ktv_array_set_obj(models, j, model_obj);
-                ktv_buffer_delete(model_buffer);
-                index += model_size;
+                ktv_array_set_obj(frame->array, frame->element++, child);
             }
-            ktv_obj_set_array(obj, field->alias, models);
+            ktv_decoder_push(decoder, child, decoder->position + length);
         }
     }
-    return;
+    return consumed;
+}
+
+ktv_obj *ktv_decoder_take(ktv_decoder *decoder)
+{
+    if (decoder == NULL)
+    {
+        return NULL;
+    }
+    ktv_obj *obj = decoder->done;
+    decoder->done = NULL;
+    return obj;
+}
+
+ktv_obj *ktv_decoder_finish(ktv_decoder *decoder)
+{
+    if (decoder == NULL)
+    {
+        return NULL;
+    }
+    if (decoder->done != NULL || decoder->depth == 0)
+    {
+        return ktv_decoder_take(decoder);
+    }
+    // a field cut in the middle is dropped, fields before it are kept
+    for (size_t i = 0; i < decoder->depth; i++)
+    {
+        ktv_decoder_drop_partial(decoder, &decoder->frames[i]);
+    }
+    ktv_obj *obj = decoder->frames[0].obj;
+    decoder->depth = 0;
+    decoder->pending_size = 0;
+    return obj;
+}
+
+void ktv_decoder_delete(ktv_decoder *decoder)
+{
+    if (decoder == NULL)
+    {
+        return;
+    }
+    ktv_obj_delete(ktv_decoder_finish(decoder));
+    free(decoder->frames);
+    free(decoder);
 }
 
 ktv_buffer *ktv_buffer_new(uint8_t *data, size_t size)
 {
     ktv_buffer *buffer = malloc(sizeof(ktv_buffer));
     buffer->size = size;
+    buffer->capacity = size;
     if (data != NULL && size > 0)
     {
         buffer->buffer = malloc(size);
@@ -724,10 +3606,39 @@ ktv_buffer *ktv_buffer_new(uint8_t *data, size_t size)
     {
         buffer->buffer = NULL;
         buffer->size = 0;
+        buffer->capacity = 0;
     }
     return buffer;
 }
 
+void ktv_buffer_reserve(ktv_buffer *buffer, size_t capacity)
+{
+    if (capacity <= buffer->capacity)
+    {
+        return;
+    }
+    // grow geometrically so that appending byte by byte stays amortized O(1)
+    size_t new_capacity = buffer->capacity < 16 ? 16 : buffer->capacity * 2;
+    if (new_capacity < capacity)
+    {
+        new_capacity = capacity;
+    }
+    buffer->buffer = realloc(buffer->buffer, new_capacity);
+    buffer->capacity = new_capacity;
+}
+
+void ktv_buffer_append(ktv_buffer *buffer, uint8_t *data, size_t size)
+{
+    ktv_buffer_reserve(buffer, buffer->size + size);
+    memcpy(buffer->buffer + buffer->size, data, size);
+    buffer->size = buffer->size + size;
+}
+
+void ktv_buffer_clear(ktv_buffer *buffer)
+{
+    buffer->size = 0;
+}
+
 void ktv_buffer_delete(ktv_buffer *buffer)
 {
     free(buffer->buffer);
@@ -794,7 +3705,7 @@ void ktv_print_obj_internal(ktv_obj *obj, int tabs)
             printf("\t");
         }
         ktv_field *field = model->fields[i];
-        void *value = obj->values[i];
+        void *value = ktv_obj_get_value_by_index(obj, i);
         printf("Field = <%s>, ", field->alias);
         if (value == NULL)
         {
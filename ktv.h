@@ -1,7 +1,11 @@
 #ifndef ktv_h
 #define ktv_h
 
+#include <stddef.h>
 #include <stdint.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+#endif
 
 #define KTV_TCHAR 0x01
 #define KTV_TBYTE 0x02
@@ -11,6 +15,36 @@
 #define KTV_TMODEL 0x11
 #define KTV_TMODEL_ARRAY 0x12
 
+#define KTV_OP_BLOCK 0x01       // run of consecutive scalar fields
+#define KTV_OP_ARRAY 0x02       // basic type array field
+#define KTV_OP_MODEL 0x03       // model field
+#define KTV_OP_MODEL_ARRAY 0x04 // model array field
+
+// char/byte array payloads shorter than this are copied instead of referenced by iovec encode
+#ifndef KTV_IOV_MIN_REF_SIZE
+#define KTV_IOV_MIN_REF_SIZE 64
+#endif
+
+// default arena chunk size in bytes
+#ifndef KTV_ARENA_CHUNK_SIZE
+#define KTV_ARENA_CHUNK_SIZE 4096
+#endif
+
+// default max object shells cached per model and array headers cached by a ktv_pool
+#ifndef KTV_POOL_CAP
+#define KTV_POOL_CAP 64
+#endif
+
+// model arrays with at least this many elements are handed to the executor by parallel encode / decode
+#ifndef KTV_PARALLEL_MIN_COUNT
+#define KTV_PARALLEL_MIN_COUNT 256
+#endif
+
+// model array elements per executor task
+#ifndef KTV_PARALLEL_SLICE_SIZE
+#define KTV_PARALLEL_SLICE_SIZE 64
+#endif
+
 struct ktv_field;
 struct ktv_model;
 
@@ -21,41 +55,248 @@ typedef struct ktv_field
     uint8_t sub_type; // type = TARRAY | type = TMODEL or TMODEL_ARRAY (value = model index)
 } ktv_field;
 
+typedef struct ktv_op
+{
+    uint8_t code;        // KTV_OP_*
+    uint8_t field_index; // first field covered by op
+    uint8_t field_count; // fields covered by op, > 1 only for KTV_OP_BLOCK
+    uint8_t sub_type;    // array element type | model index
+    uint16_t size;       // wire size of KTV_OP_BLOCK | element size of KTV_OP_ARRAY
+} ktv_op;
+
+typedef struct ktv_scalar_op
+{
+    uint16_t offset; // slot of the scalar in ktv_obj data
+    uint8_t width;   // wire & slot size: 1, 2 or 4
+} ktv_scalar_op;
+
 typedef struct ktv_model
 {
     char *name;
     uint8_t field_count;
     struct ktv_field **fields;
+    uint8_t op_count;
+    struct ktv_op *ops; // codec program compiled by ktv_tree_new
+    struct ktv_scalar_op *scalars; // copy entry of each scalar field by field index, used by KTV_OP_BLOCK
+    size_t fixed_size;  // wire size of scalars & length / count prefixes
+    uint16_t *offsets;  // slot of each field in ktv_obj data, computed by ktv_tree_new
+    size_t data_size;   // presence bitmap + slots
+    uint8_t *alias_table; // open addressing table of field index by alias, built by ktv_tree_new
+    uint16_t alias_mask;  // alias_table size - 1
 } ktv_model;
 
 typedef struct ktv_tree
 {
     uint8_t model_count;
     struct ktv_model **models;
+    uint8_t *name_table; // open addressing table of model index by name
+    uint16_t name_mask;  // name_table size - 1
 } ktv_tree;
 
+typedef struct ktv_arena_chunk
+{
+    struct ktv_arena_chunk *next; // older chunk
+    size_t size;
+    size_t used;
+    uint8_t data[];
+} ktv_arena_chunk;
+
+// bump allocator for request-scoped object graphs
+typedef struct ktv_arena
+{
+    ktv_arena_chunk *chunk; // current chunk, head of chain
+    size_t chunk_size;
+} ktv_arena;
+
+// cache of freed object shells per model & array headers of one tree, used by the thread it is attached to
+typedef struct ktv_pool
+{
+    struct ktv_tree *tree;
+    struct ktv_obj **objs; // free list per model, linked through the first word of each shell
+    size_t *obj_counts;
+    struct ktv_array *arrays; // free list of array headers
+    size_t array_count;
+    size_t cap;    // max cached shells per model, and max cached array headers
+    size_t hits;   // allocations served from the pool
+    size_t misses; // allocations falling back to malloc
+    size_t attached; // threads the pool is attached to
+} ktv_pool;
+
 typedef struct ktv_obj
 {
     ktv_tree *tree;
+    ktv_arena *arena; // nullable, owns all memory of the object and its children
     uint8_t model_index;
-    void **values;
+    uint8_t *data; // presence bitmap of scalars, then inline scalars & array / model pointers, laid out by model
 } ktv_obj;
 
+// model resolved once by name, for ktv_obj_new_h
+typedef struct ktv_model_handle
+{
+    struct ktv_tree *tree; // tree the handle was resolved against
+    uint8_t model_index;   // 0xFF if name is unknown
+} ktv_model_handle;
+
+// field resolved once by model name & alias, for ktv_obj_*_h
+typedef struct ktv_field_handle
+{
+    struct ktv_tree *tree; // tree the handle was resolved against
+    uint8_t model_index;   // 0xFF if name / alias is unknown
+    uint8_t field_index;
+    uint8_t type;
+    uint16_t offset; // slot in ktv_obj data
+} ktv_field_handle;
+
 typedef struct ktv_array
 {
+    ktv_arena *arena; // nullable
     uint8_t type;
     uint8_t sub_type;
     void *values;
     ktv_obj **objects;
     uint16_t count;
+    uint16_t capacity; // elements allocated in values / objects
 } ktv_array;
 
 typedef struct ktv_buffer
 {
     size_t size;
+    size_t capacity;
     uint8_t *buffer;
 } ktv_buffer;
 
+// fields selected for projection decode, one field bitmask per model of the tree
+typedef struct ktv_mask
+{
+    ktv_tree *tree;
+    uint8_t *bits;
+} ktv_mask;
+
+// encoded bytes of a model checked by ktv_validate
+typedef struct ktv_verified
+{
+    ktv_tree *tree;
+    uint8_t model_index;
+    uint8_t *data; // not owned
+    size_t size;
+} ktv_verified;
+
+typedef struct ktv_view
+{
+    ktv_tree *tree;
+    uint8_t model_index;
+    const uint8_t *data; // encoded bytes, not owned, NULL if view is invalid
+    size_t size;
+} ktv_view;
+
+#if defined(__unix__) || defined(__APPLE__)
+typedef struct iovec ktv_iovec;
+#else
+typedef struct ktv_iovec
+{
+    void *iov_base;
+    size_t iov_len;
+} ktv_iovec;
+#endif
+
+// offsets of every element of an encoded model array, for random access
+typedef struct ktv_array_index
+{
+    ktv_tree *tree;
+    uint8_t model_index;  // element model
+    const uint8_t *data;  // encoded bytes of the view index was built from, not owned
+    uint16_t count;       // elements present in data
+    size_t *offsets;      // offset of each element's length prefix in data
+} ktv_array_index;
+
+// position of push decoder inside one nested model
+typedef struct ktv_decoder_frame
+{
+    ktv_obj *obj;
+    size_t end;          // stream position where the model's bytes end, SIZE_MAX for the root
+    uint8_t op_index;    // current op of the model's codec program
+    uint8_t field_index; // next field inside a block op
+    uint8_t stage;       // 0 = before length / count prefix, 1 = inside array payload / elements
+    uint16_t count;      // element count of current model array
+    uint16_t element;    // next element of current model array
+    ktv_array *array;    // array being filled
+    size_t copied;       // array payload bytes received
+} ktv_decoder_frame;
+
+// resumable push decoder for messages arriving in fragments
+typedef struct ktv_decoder
+{
+    ktv_tree *tree;
+    uint8_t model_index;
+    ktv_decoder_frame *frames; // model stack, frames[0] is the root
+    size_t depth;
+    size_t capacity;
+    size_t position;     // bytes of current message consumed
+    uint8_t pending[4];  // scalar / prefix split across fragments
+    uint8_t pending_size;
+    ktv_obj *done;       // completed message waiting for ktv_decoder_take
+} ktv_decoder;
+
+/**
+ * receives encoded bytes from streaming encode
+ * returns 0 to continue, non zero to abort
+ */
+typedef int (*ktv_sink)(void *context, const uint8_t *data, size_t size);
+
+/**
+ * unit of work handed to an executor
+ */
+typedef void (*ktv_task)(void *argument, size_t index);
+
+/**
+ * runs task(argument, index) for every index in [0, count), possibly concurrently on a worker pool,
+ * and returns once all of them are done
+ */
+typedef void (*ktv_executor)(void *context, ktv_task task, void *argument, size_t count);
+
+/**
+ * create an arena allocating chunks of chunk_size bytes (0 for KTV_ARENA_CHUNK_SIZE)
+ */
+ktv_arena *ktv_arena_new(size_t chunk_size);
+
+/**
+ * bump allocate size bytes, pointer aligned
+ */
+void *ktv_arena_alloc(ktv_arena *arena, size_t size);
+
+/**
+ * release everything allocated from arena at once, keeping one chunk for reuse
+ */
+void ktv_arena_reset(ktv_arena *arena);
+
+/**
+ * release arena and all its chunks
+ */
+void ktv_arena_delete(ktv_arena *arena);
+
+/**
+ * create a pool for objects & arrays of tree, caching up to cap entries per free list (0 for KTV_POOL_CAP)
+ */
+ktv_pool *ktv_pool_new(ktv_tree *tree, size_t cap);
+
+/**
+ * attach pool to the calling thread (NULL to detach), heap objects & arrays of pool's tree
+ * created or deleted on this thread then recycle through the pool, without any locking,
+ * so a pool serves one thread at a time and hand-over between threads needs the caller's synchronization
+ */
+void ktv_pool_attach(ktv_pool *pool);
+
+/**
+ * pool attached to the calling thread, NULL if none
+ */
+ktv_pool *ktv_pool_current(void);
+
+/**
+ * release pool and the memory it caches, detaching it from the calling thread
+ * every other thread must detach first, returns -1 and keeps the pool if one is still attached, 0 otherwise
+ */
+int ktv_pool_delete(ktv_pool *pool);
+
 /**
  * generate model tree from parsed proto
  */
@@ -71,12 +312,25 @@ void ktv_tree_delete(ktv_tree *tree);
  */
 ktv_obj *ktv_obj_new(ktv_tree *tree, const char *name);
 
+/**
+ * create an object in arena, its children, arrays & values come from the same arena
+ * such graphs are released all at once by ktv_arena_reset / ktv_arena_delete, ktv_obj_delete does nothing on them
+ * only arena objects / arrays of the same arena may be set into an arena object
+ */
+ktv_obj *ktv_obj_new_in(ktv_arena *arena, ktv_tree *tree, const char *name);
+
 /**
  * release an object
  * recursively release all child object/array
  */
 void ktv_obj_delete(ktv_obj *obj);
 
+/**
+ * clear every field of object, keeping nested objects, arrays & scalar slots
+ * a following ktv_obj_decode into the object reuses them instead of allocating
+ */
+void ktv_obj_reset(ktv_obj *obj);
+
 /**
  * get/set value for ktv_obj by type
  */
@@ -98,6 +352,57 @@ ktv_obj *ktv_obj_get_obj(ktv_obj *obj, const char *alias);
 void ktv_obj_set_array(ktv_obj *obj, const char *alias, ktv_array *value);
 ktv_array *ktv_obj_get_array(ktv_obj *obj, const char *alias);
 
+/**
+ * index of field in object's model (declaration order in proto), 0xFF if alias is unknown
+ */
+uint8_t ktv_obj_field_index(ktv_obj *obj, const char *alias);
+
+/**
+ * raw value of field by index: pointer to inline scalar, ktv_array* or ktv_obj*, NULL if unset
+ */
+void *ktv_obj_get_value_by_index(ktv_obj *obj, uint8_t field_index);
+
+/**
+ * set value for ktv_obj by field index, skips alias lookup
+ * ignored if index is out of range or field type does not match
+ */
+void ktv_obj_set_char_by_index(ktv_obj *obj, uint8_t field_index, char value);
+void ktv_obj_set_byte_by_index(ktv_obj *obj, uint8_t field_index, int8_t value);
+void ktv_obj_set_int2_by_index(ktv_obj *obj, uint8_t field_index, int16_t value);
+void ktv_obj_set_int4_by_index(ktv_obj *obj, uint8_t field_index, int32_t value);
+void ktv_obj_set_obj_by_index(ktv_obj *obj, uint8_t field_index, ktv_obj *value);
+void ktv_obj_set_array_by_index(ktv_obj *obj, uint8_t field_index, ktv_array *value);
+
+/**
+ * resolve model / field once, e.g. at startup, for get/set without any name lookup
+ */
+ktv_model_handle ktv_model_resolve(ktv_tree *tree, const char *name);
+ktv_field_handle ktv_field_resolve(ktv_tree *tree, const char *name, const char *alias);
+
+/**
+ * create an object / get/set value for ktv_obj by resolved handle
+ * set is ignored and get returns 0 / NULL if handle does not belong to object's tree, model or type
+ */
+ktv_obj *ktv_obj_new_h(ktv_tree *tree, ktv_model_handle model);
+
+void ktv_obj_set_char_h(ktv_obj *obj, ktv_field_handle field, char value);
+char ktv_obj_get_char_h(ktv_obj *obj, ktv_field_handle field);
+
+void ktv_obj_set_byte_h(ktv_obj *obj, ktv_field_handle field, int8_t value);
+int8_t ktv_obj_get_byte_h(ktv_obj *obj, ktv_field_handle field);
+
+void ktv_obj_set_int2_h(ktv_obj *obj, ktv_field_handle field, int16_t value);
+int16_t ktv_obj_get_int2_h(ktv_obj *obj, ktv_field_handle field);
+
+void ktv_obj_set_int4_h(ktv_obj *obj, ktv_field_handle field, int32_t value);
+int32_t ktv_obj_get_int4_h(ktv_obj *obj, ktv_field_handle field);
+
+void ktv_obj_set_obj_h(ktv_obj *obj, ktv_field_handle field, ktv_obj *value);
+ktv_obj *ktv_obj_get_obj_h(ktv_obj *obj, ktv_field_handle field);
+
+void ktv_obj_set_array_h(ktv_obj *obj, ktv_field_handle field, ktv_array *value);
+ktv_array *ktv_obj_get_array_h(ktv_obj *obj, ktv_field_handle field);
+
 /**
  * create an array by type
  */
@@ -127,16 +432,238 @@ void ktv_array_set_obj(ktv_array *array, uint16_t index, ktv_obj *obj);
  */
 ktv_buffer *ktv_obj_encode(ktv_obj *obj);
 
+/**
+ * exact encoded size of object in bytes
+ */
+size_t ktv_obj_encoded_size(ktv_obj *obj);
+
+/**
+ * object -> bytes, written into caller owned memory without any allocation
+ * returns encoded size, or 0 if capacity is not enough
+ */
+size_t ktv_obj_encode_into(ktv_obj *obj, uint8_t *dst, size_t capacity);
+
+/**
+ * object -> bytes, appended to the end of an existing buffer
+ * returns appended size
+ */
+size_t ktv_obj_encode_append(ktv_obj *obj, ktv_buffer *buffer);
+
+/**
+ * object -> iovec list, ready for writev / sendmsg
+ * headers & scalars are written into scratch, large char/byte array payloads are referenced in place
+ * iov_count: capacity of iov on input, used entries on output
+ * returns encoded size, or 0 if scratch or iov is not enough
+ */
+size_t ktv_obj_encode_iov(ktv_obj *obj, uint8_t *scratch, size_t scratch_capacity, ktv_iovec *iov, size_t *iov_count);
+
+/**
+ * object -> bytes, emitted through sink in chunks of chunk_size bytes (the last one may be shorter)
+ * encoded bytes only ever live in the caller provided chunk, besides it a sizing pass keeps
+ * one 2 byte length prefix per nested model on the heap
+ * returns encoded size, or 0 if sink aborted or the prefixes could not be allocated
+ */
+size_t ktv_obj_encode_stream(ktv_obj *obj, uint8_t *chunk, size_t chunk_size, ktv_sink sink, void *context);
+
+/**
+ * objects -> one buffer holding every message framed as [2 bytes size][message bytes]
+ * offsets (nullable) receives the offset of each message's bytes in the buffer, one entry per object
+ * returns NULL if a message does not fit its 2 byte size
+ */
+ktv_buffer *ktv_encode_batch(ktv_obj **objs, size_t count, size_t *offsets);
+
+/**
+ * object -> bytes, elements of large model arrays in the object are encoded by the executor
+ * output is identical to ktv_obj_encode
+ */
+ktv_buffer *ktv_obj_encode_parallel(ktv_obj *obj, ktv_executor executor, void *context);
+
 /**
  * bytes -> object
+ * every length & count is checked against the input, decoding stops at the first one that runs past it;
+ * ktv_validate + ktv_obj_decode_verified runs those checks in one pass up front instead
  */
 void ktv_obj_decode(ktv_obj *obj, ktv_buffer *buffer);
 
+/**
+ * bytes -> object, elements of large model arrays in the object are decoded by the executor
+ * element offsets are found by a scan of their length prefixes first
+ */
+void ktv_obj_decode_parallel(ktv_obj *obj, ktv_buffer *buffer, ktv_executor executor, void *context);
+
+/**
+ * bytes -> object, only fields selected in mask are materialized
+ * unwanted arrays, models & model arrays are skipped by their length prefixes without being parsed
+ */
+void ktv_obj_decode_fields(ktv_obj *obj, ktv_buffer *buffer, ktv_mask *mask);
+
+/**
+ * object -> bytes in sparse format: per object a presence bitmap of (field count + 7) / 8 bytes,
+ * followed by present fields only, nested models included; not wire compatible with ktv_obj_encode
+ */
+ktv_buffer *ktv_obj_encode_sparse(ktv_obj *obj);
+
+/**
+ * sparse format bytes -> object, fields absent from the input are left untouched
+ * decoding stops at the first length / count that runs past the input
+ */
+void ktv_obj_decode_sparse(ktv_obj *obj, ktv_buffer *buffer);
+
+/**
+ * check sparse format bytes of model in one linear pass, without building any object
+ * input may end at any field boundary, returns 0 if valid, -1 if any bitmap / length / count runs past it
+ */
+int ktv_validate_sparse(ktv_tree *tree, const char *name, uint8_t *data, size_t size);
+
+/**
+ * create an empty field mask for tree
+ */
+ktv_mask *ktv_mask_new(ktv_tree *tree);
+
+/**
+ * select a dotted field path starting at model name, e.g. ("user", "job.title")
+ * a path ending at a model / model array field selects all of its fields
+ * masks are per model, so a selection applies wherever that model appears
+ * returns 0 on success, -1 if path does not resolve
+ */
+int ktv_mask_add(ktv_mask *mask, const char *name, const char *path);
+
+/**
+ * release field mask
+ */
+void ktv_mask_delete(ktv_mask *mask);
+
+/**
+ * check encoded bytes of model in one linear pass, without building any object
+ * on success fills verified and returns 0, returns -1 if any length / count runs past the input
+ */
+int ktv_validate(ktv_tree *tree, const char *name, uint8_t *data, size_t size, ktv_verified *verified);
+
+/**
+ * bytes -> object for input checked by ktv_validate, lengths & counts are not checked again
+ * obj must be created from the same tree & model, verified bytes must still be alive
+ */
+void ktv_obj_decode_verified(ktv_obj *obj, ktv_verified *verified);
+
+/**
+ * read-only view over encoded bytes of a model, fields are read in place without decoding
+ * bytes must outlive the view and every view / pointer taken from it
+ */
+ktv_view ktv_view_new(ktv_tree *tree, const char *name, const uint8_t *data, size_t size);
+
+/**
+ * get value from view by type, returns 0 if field is missing or truncated
+ */
+char ktv_view_get_char(ktv_view *view, const char *alias);
+int8_t ktv_view_get_byte(ktv_view *view, const char *alias);
+int16_t ktv_view_get_int2(ktv_view *view, const char *alias);
+int32_t ktv_view_get_int4(ktv_view *view, const char *alias);
+
+/**
+ * element count of array / model array field
+ */
+uint16_t ktv_view_get_count(ktv_view *view, const char *alias);
+
+/**
+ * pointer into view bytes, not null terminated, count receives element count
+ */
+const char *ktv_view_get_string(ktv_view *view, const char *alias, uint16_t *count);
+const int8_t *ktv_view_get_bytes(ktv_view *view, const char *alias, uint16_t *count);
+
+/**
+ * element of int2 / int4 array, converted from big endian on read
+ */
+int16_t ktv_view_get_int2_at(ktv_view *view, const char *alias, uint16_t index);
+int32_t ktv_view_get_int4_at(ktv_view *view, const char *alias, uint16_t index);
+
+/**
+ * nested view of model / model array element, data is NULL if missing
+ */
+ktv_view ktv_view_get_obj(ktv_view *view, const char *alias);
+ktv_view ktv_view_get_obj_at(ktv_view *view, const char *alias, uint16_t index);
+
+/**
+ * index a model array field of view in one prescan, for O(1) access to any element
+ * returns NULL if field is missing, elements truncated by the end of view are not indexed
+ */
+ktv_array_index *ktv_array_index_new(ktv_view *view, const char *alias);
+
+/**
+ * view of element at index, data is NULL if index is out of range
+ */
+ktv_view ktv_array_index_view(ktv_array_index *array_index, uint16_t index);
+
+/**
+ * decode element at index into a new object, NULL if index is out of range
+ */
+ktv_obj *ktv_array_index_decode(ktv_array_index *array_index, uint16_t index);
+
+/**
+ * decode up to count elements starting at first into objs
+ * returns number of objects written
+ */
+uint16_t ktv_array_index_decode_range(ktv_array_index *array_index, uint16_t first, uint16_t count, ktv_obj **objs);
+
+/**
+ * release array index
+ */
+void ktv_array_index_delete(ktv_array_index *array_index);
+
+/**
+ * create a push decoder for messages of model name
+ */
+ktv_decoder *ktv_decoder_new(ktv_tree *tree, const char *name);
+
+/**
+ * feed the next fragment of a message, decoder keeps its position between calls
+ * returns bytes consumed, less than size once the message is complete (the rest belongs to the next message)
+ * nothing is consumed until a completed message is taken
+ */
+size_t ktv_decoder_feed(ktv_decoder *decoder, const uint8_t *data, size_t size);
+
+/**
+ * completed message, NULL if current message is not complete yet
+ * the caller owns the returned object, decoder is ready for the next message
+ */
+ktv_obj *ktv_decoder_take(ktv_decoder *decoder);
+
+/**
+ * end current message at the bytes fed so far, like decoding a truncated buffer
+ * the caller owns the returned object (nullable), decoder is ready for the next message
+ */
+ktv_obj *ktv_decoder_finish(ktv_decoder *decoder);
+
+/**
+ * release decoder and any message still in progress
+ */
+void ktv_decoder_delete(ktv_decoder *decoder);
+
+/**
+ * force the portable loop for int2 / int4 array byte order conversion (scalar = 1), or go back to the
+ * SIMD kernels picked for this cpu (scalar = 0); meant for benchmarks, call while no encode / decode runs
+ */
+void ktv_set_scalar_kernels(int scalar);
+
 /**
  * create buffer
  */
 ktv_buffer *ktv_buffer_new(uint8_t *buffer, size_t size);
 
+/**
+ * make sure buffer can hold at least capacity bytes, grows geometrically
+ */
+void ktv_buffer_reserve(ktv_buffer *buffer, size_t capacity);
+
+/**
+ * append bytes to the end of buffer
+ */
+void ktv_buffer_append(ktv_buffer *buffer, uint8_t *data, size_t size);
+
+/**
+ * drop buffer content but keep its storage for reuse
+ */
+void ktv_buffer_clear(ktv_buffer *buffer);
+
 /**
  * delete buffer
  */
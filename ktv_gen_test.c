@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ktv.h"
+#include "ktv_test.proto.h"
+#include "ktv_test_common.h"
+
+ktv_obj *new_test_user_with_mentor(ktv_tree *tree)
+{
+    ktv_obj *user = new_test_user(tree);
+    ktv_obj *mentor = ktv_obj_new(tree, "user");
+    ktv_obj_set_byte(mentor, "age", 45);
+    ktv_obj_set_byte(mentor, "gender", 0);
+    ktv_array *mentor_array = ktv_array_new_objs(user, "mentor", 1);
+    ktv_array_set_obj(mentor_array, 0, mentor);
+    ktv_obj_set_array(user, "mentor", mentor_array);
+    return user;
+}
+
+void generated_decode_test(ktv_tree *tree)
+{
+    printf("\n=== Generated Decode ===\n");
+    ktv_obj *user = new_test_user_with_mentor(tree);
+    ktv_buffer *expected = ktv_obj_encode(user);
+
+    uint8_t scratch_data[512];
+    ktv_test_scratch scratch = {scratch_data, 0, sizeof(scratch_data)};
+    ktv_test_user decoded;
+    int result = ktv_test_user_decode(&decoded, expected->buffer, expected->size, &scratch);
+    print_result("decode", result == 0 && decoded.age == 30 && decoded.job != NULL && decoded.job->type == 2 &&
+                               decoded.tasks_count == 2 && decoded.tasks[1].time_count == 2 &&
+                               decoded.tasks[1].time[1] == -7654321 && decoded.name_count == 8 &&
+                               memcmp(decoded.name, "Zhang Ji", 8) == 0 &&
+                               decoded.mentor_count == 1 && decoded.mentor[0].age == 45);
+
+    uint8_t encoded[256];
+    size_t size = ktv_test_user_encode(&decoded, encoded, sizeof(encoded));
+    print_result("encode wire compatible", size == expected->size && memcmp(encoded, expected->buffer, size) == 0);
+    print_result("encode overflow", ktv_test_user_encode(&decoded, encoded, size - 1) == 0);
+
+    scratch.size = 0;
+    print_result("decode truncated", ktv_test_user_decode(&decoded, expected->buffer, 10, &scratch) == -1);
+    ktv_test_scratch small_scratch = {scratch_data, 0, 8};
+    print_result("decode scratch overflow",
+                 ktv_test_user_decode(&decoded, expected->buffer, expected->size, &small_scratch) == -1);
+
+    ktv_buffer_delete(expected);
+    ktv_obj_delete(user);
+}
+
+void generated_encode_test(ktv_tree *tree)
+{
+    printf("\n=== Generated Encode ===\n");
+    ktv_test_PhoneNumber numbers[2] = {{9, "123456789", 1}, {8, "87654321", 2}};
+    ktv_test_Person person = {5, "Alice", 10000, 0, NULL, 2, numbers};
+    ktv_test_AddressBook address_book = {1, &person};
+
+    uint8_t encoded[256];
+    size_t size = ktv_test_AddressBook_encode(&address_book, encoded, sizeof(encoded));
+    printf("Encoded Size: %zu\n", size);
+
+    ktv_buffer *buffer = ktv_buffer_new(encoded, size);
+    ktv_obj *decoded = ktv_obj_new(tree, "AddressBook");
+    ktv_obj_decode(decoded, buffer);
+    ktv_obj *decoded_person = ktv_array_get_obj(ktv_obj_get_array(decoded, "person"), 0);
+    ktv_obj *decoded_number = ktv_array_get_obj(ktv_obj_get_array(decoded_person, "phone"), 1);
+    print_result("ktv_obj_decode", ktv_obj_get_int4(decoded_person, "id") == 10000 &&
+                                       ktv_obj_get_byte(decoded_number, "type") == 2);
+
+    ktv_buffer *reencoded = ktv_obj_encode(decoded);
+    print_result("ktv_obj_encode wire compatible", reencoded->size == size &&
+                                                       memcmp(reencoded->buffer, encoded, size) == 0);
+    ktv_buffer_delete(reencoded);
+    ktv_buffer_delete(buffer);
+    ktv_obj_delete(decoded);
+}
+
+void generated_benchmark_test(ktv_tree *tree, int repeat)
+{
+    printf("\n=== Generated Benchmark ===\n");
+    clock_t start, stop;
+    ktv_obj *user = new_test_user_with_mentor(tree);
+    ktv_buffer *buffer = ktv_obj_encode(user);
+
+    start = clock();
+    for (int i = 0; i < repeat; i++)
+    {
+        ktv_obj *decoded = ktv_obj_new(tree, "user");
+        ktv_obj_decode(decoded, buffer);
+        ktv_obj_delete(decoded);
+    }
+    stop = clock();
+    printf("ktv_obj_decode Repeat %d times: %f (s)\n", repeat, (double)(stop - start) / CLOCKS_PER_SEC);
+
+    uint8_t scratch_data[512];
+    ktv_test_user decoded;
+    start = clock();
+    for (int i = 0; i < repeat; i++)
+    {
+        ktv_test_scratch scratch = {scratch_data, 0, sizeof(scratch_data)};
+        ktv_test_user_decode(&decoded, buffer->buffer, buffer->size, &scratch);
+    }
+    stop = clock();
+    printf("ktv_test_user_decode Repeat %d times: %f (s)\n", repeat, (double)(stop - start) / CLOCKS_PER_SEC);
+
+    uint8_t encoded[256];
+    start = clock();
+    for (int i = 0; i < repeat; i++)
+    {
+        ktv_obj_encode_into(user, encoded, sizeof(encoded));
+    }
+    stop = clock();
+    printf("ktv_obj_encode_into Repeat %d times: %f (s)\n", repeat, (double)(stop - start) / CLOCKS_PER_SEC);
+
+    start = clock();
+    for (int i = 0; i < repeat; i++)
+    {
+        ktv_test_user_encode(&decoded, encoded, sizeof(encoded));
+    }
+    stop = clock();
+    printf("ktv_test_user_encode Repeat %d times: %f (s)\n", repeat, (double)(stop - start) / CLOCKS_PER_SEC);
+
+    ktv_buffer_delete(buffer);
+    ktv_obj_delete(user);
+}
+
+int main(int argc, char const *argv[])
+{
+    FILE *f = fopen("ktv_test.proto.bin", "rb");
+    fseek(f, 0, SEEK_END);
+    int fsize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t content[fsize];
+    fread(content, fsize, 1, f);
+    fclose(f);
+
+    ktv_tree *tree = ktv_tree_new(content, fsize);
+    generated_decode_test(tree);
+    generated_encode_test(tree);
+    generated_benchmark_test(tree, 100000);
+
+    ktv_tree_delete(tree);
+    return 0;
+}
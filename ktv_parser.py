@@ -1,10 +1,14 @@
 # -*- coding: utf-8 -*-
 # https://phab.gotokeep.com/T129998
+import os
+import re
 import sys
 
 PREFIX_MODEL = '#'
 PREFIX_ARRAY = '*'
 
+OPTION_C = '--c'
+
 TYPE_CHAR = 'char'
 TYPE_BYTE = 'byte'
 TYPE_INT2 = 'int2'
@@ -25,6 +29,10 @@ TYPE_MAP = {
 }
 
 def parse(lines):
+    return encode(parseModels(lines))
+
+
+def parseModels(lines):
     parsed = []
     modelName = None
     fields = []
@@ -46,7 +54,7 @@ def parse(lines):
             fields.append(value)
     if modelName != None:
         parsed.append((modelName, fields))
-    return encode(parsed)
+    return parsed
 
 
 def parseLine(lineNo, line):
@@ -80,7 +88,7 @@ def parseLine(lineNo, line):
 
 
 def encode(models):
-    print models
+    print(models)
     basicNames = [TYPE_CHAR, TYPE_BYTE, TYPE_INT2, TYPE_INT4]
     modelNames = []
     for model in models:
@@ -149,28 +157,314 @@ def encode(models):
                 modelBytes.append(TYPE_MAP[TYPE_MODEL_ARRAY])
                 modelBytes.append(modelNames.index(fieldType))
         resultBytes.extend(modelBytes)
-        print "\n==== model %s ====" % (modelName)
-        print toPrintableBytes(modelBytes)
+        print("\n==== model %s ====" % (modelName))
+        print(toPrintableBytes(modelBytes))
     return resultBytes
 
 
 def isValidName(s):
     return s.isalnum() and s[0].isalpha and len(s) < 255
 
+C_TYPES = {
+    TYPE_CHAR: 'char',
+    TYPE_BYTE: 'int8_t',
+    TYPE_INT2: 'int16_t',
+    TYPE_INT4: 'int32_t',
+}
+
+C_SIZES = {
+    TYPE_CHAR: 1,
+    TYPE_BYTE: 1,
+    TYPE_INT2: 2,
+    TYPE_INT4: 4,
+}
+
+C_KEYWORDS = set([
+    'auto', 'break', 'case', 'char', 'const', 'continue', 'default', 'do',
+    'double', 'else', 'enum', 'extern', 'float', 'for', 'goto', 'if',
+    'inline', 'int', 'long', 'register', 'restrict', 'return', 'short',
+    'signed', 'sizeof', 'static', 'struct', 'switch', 'typedef', 'union',
+    'unsigned', 'void', 'volatile', 'while', 'value', 'size', 'src', 'dst',
+    'pos', 'scratch', 'capacity',
+])
+
+C_HEADER_TEMPLATE = """// generated by ktv_parser.py from %(source)s, do not edit
+#ifndef %(guard)s
+#define %(guard)s
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * caller owned memory backing decoded int arrays & nested models
+ */
+typedef struct %(prefix)s_scratch
+{
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} %(prefix)s_scratch;
+
+%(typedefs)s
+%(structs)s%(functions)s#endif
+"""
+
+C_FUNCTIONS_TEMPLATE = """/**
+ * %(model)s <-> bytes, wire compatible with ktv_obj_encode / ktv_obj_decode
+ * encode returns encoded size, or 0 if capacity is not enough
+ * decode returns 0, or -1 if bytes are malformed or scratch is not enough
+ * decoded char / byte arrays point into src
+ */
+size_t %(name)s_encoded_size(const %(name)s *value);
+size_t %(name)s_encode(const %(name)s *value, uint8_t *dst, size_t capacity);
+int %(name)s_decode(%(name)s *value, const uint8_t *src, size_t size, %(prefix)s_scratch *scratch);
+"""
+
+C_SOURCE_TEMPLATE = """// generated by ktv_parser.py from %(source)s, do not edit
+#include <string.h>
+#include "%(header)s"
+
+#define KTV_GEN_ALIGNOF(type) offsetof(struct { char c; type t; }, t)
+#define KTV_GEN_END() do { if (pos >= size) return 0; } while (0)
+#define KTV_GEN_NEED(n) do { if (size - pos < (size_t)(n)) return -1; } while (0)
+
+static void %(prefix)s_put2(uint8_t *dst, uint16_t value)
+{
+    dst[0] = value >> 8;
+    dst[1] = value >> 0;
+}
+
+static void %(prefix)s_put4(uint8_t *dst, uint32_t value)
+{
+    dst[0] = value >> 24;
+    dst[1] = value >> 16;
+    dst[2] = value >> 8;
+    dst[3] = value >> 0;
+}
+
+static uint16_t %(prefix)s_get2(const uint8_t *src)
+{
+    return (uint16_t)src[0] << 8 | (uint16_t)src[1];
+}
+
+static uint32_t %(prefix)s_get4(const uint8_t *src)
+{
+    return (uint32_t)src[0] << 24 | (uint32_t)src[1] << 16 | (uint32_t)src[2] << 8 | (uint32_t)src[3];
+}
+
+static void *%(prefix)s_alloc(%(prefix)s_scratch *scratch, size_t size, size_t align)
+{
+    size_t pad = (align - (uintptr_t)(scratch->data + scratch->size) %% align) %% align;
+    if (scratch->data == NULL || scratch->capacity - scratch->size < pad + size)
+    {
+        return NULL;
+    }
+    void *data = scratch->data + scratch->size + pad;
+    scratch->size += pad + size;
+    return data;
+}
+
+%(declarations)s
+%(bodies)s"""
+
+
+def cName(name):
+    return name + '_' if name in C_KEYWORDS else name
+
+
+def generateC(fileName, models):
+    source = os.path.basename(fileName)
+    prefix = re.sub(r'[^0-9a-zA-Z_]', '_', source.split('.')[0])
+    header = '%s.h' % (source)
+    structName = lambda modelName: '%s_%s' % (prefix, modelName)
+
+    typedefs = ''
+    structs = ''
+    functions = ''
+    declarations = ''
+    bodies = ''
+    for modelName, fields in models:
+        name = structName(modelName)
+        typedefs += 'typedef struct %s %s;\n' % (name, name)
+        members = ''
+        fixedSize = 0
+        sizeLines = []
+        writeLines = []
+        readLines = []
+        for alias, isArray, fieldType in fields:
+            member = cName(alias)
+            isBasic = fieldType in C_TYPES
+            readLines.append('KTV_GEN_END();')
+            if isBasic and not isArray:
+                members += '    %s %s;\n' % (C_TYPES[fieldType], member)
+                width = C_SIZES[fieldType]
+                fixedSize += width
+                readLines.append('KTV_GEN_NEED(%d);' % (width))
+                if width == 1:
+                    writeLines.append('dst[0] = (uint8_t)value->%s;' % (member))
+                    readLines.append('value->%s = (%s)src[pos];' % (member, C_TYPES[fieldType]))
+                else:
+                    writeLines.append('%s_put%d(dst, (uint%d_t)value->%s);' % (prefix, width, width * 8, member))
+                    readLines.append('value->%s = (%s)%s_get%d(src + pos);' % (member, C_TYPES[fieldType], prefix, width))
+                writeLines.append('dst += %d;' % (width))
+                readLines.append('pos += %d;' % (width))
+            elif isBasic and isArray:
+                members += '    uint16_t %s_count;\n' % (member)
+                members += '    const %s *%s;\n' % (C_TYPES[fieldType], member)
+                width = C_SIZES[fieldType]
+                fixedSize += 2
+                sizeLines.append('size += (size_t)value->%s_count * %d;' % (member, width))
+                writeLines.append('%s_put2(dst, value->%s_count);' % (prefix, member))
+                writeLines.append('dst += 2;')
+                readLines.append('KTV_GEN_NEED(2);')
+                readLines.append('value->%s_count = %s_get2(src + pos);' % (member, prefix))
+                readLines.append('pos += 2;')
+                readLines.append('KTV_GEN_NEED((size_t)value->%s_count * %d);' % (member, width))
+                if width == 1:
+                    writeLines.append('if (value->%s_count > 0)' % (member))
+                    writeLines.append('{')
+                    writeLines.append('    memcpy(dst, value->%s, value->%s_count);' % (member, member))
+                    writeLines.append('}')
+                    writeLines.append('dst += value->%s_count;' % (member))
+                    readLines.append('value->%s = value->%s_count > 0 ? (const %s *)(src + pos) : NULL;' % (member, member, C_TYPES[fieldType]))
+                else:
+                    writeLines.append('for (size_t i = 0; i < value->%s_count; i++, dst += %d)' % (member, width))
+                    writeLines.append('{')
+                    writeLines.append('    %s_put%d(dst, (uint%d_t)value->%s[i]);' % (prefix, width, width * 8, member))
+                    writeLines.append('}')
+                    readLines.append('if (value->%s_count > 0)' % (member))
+                    readLines.append('{')
+                    readLines.append('    %s *items = %s_alloc(scratch, sizeof(%s) * value->%s_count, KTV_GEN_ALIGNOF(%s));' % (C_TYPES[fieldType], prefix, C_TYPES[fieldType], member, C_TYPES[fieldType]))
+                    readLines.append('    if (items == NULL)')
+                    readLines.append('    {')
+                    readLines.append('        return -1;')
+                    readLines.append('    }')
+                    readLines.append('    for (size_t i = 0; i < value->%s_count; i++)' % (member))
+                    readLines.append('    {')
+                    readLines.append('        items[i] = (%s)%s_get%d(src + pos + i * %d);' % (C_TYPES[fieldType], prefix, width, width))
+                    readLines.append('    }')
+                    readLines.append('    value->%s = items;' % (member))
+                    readLines.append('}')
+                readLines.append('pos += (size_t)value->%s_count * %d;' % (member, width))
+            elif not isArray:
+                subName = structName(fieldType)
+                members += '    const %s *%s;\n' % (subName, member)
+                fixedSize += 2
+                sizeLines.append('size += value->%s != NULL ? %s_encoded_size(value->%s) : 0;' % (member, subName, member))
+                writeLines.append('{')
+                writeLines.append('    uint8_t *start = dst + 2;')
+                writeLines.append('    uint8_t *end = value->%s != NULL ? %s_write(value->%s, start) : start;' % (member, subName, member))
+                writeLines.append('    %s_put2(dst, (uint16_t)(end - start));' % (prefix))
+                writeLines.append('    dst = end;')
+                writeLines.append('}')
+                readLines.append('KTV_GEN_NEED(2);')
+                readLines.append('{')
+                readLines.append('    size_t length = %s_get2(src + pos);' % (prefix))
+                readLines.append('    pos += 2;')
+                readLines.append('    KTV_GEN_NEED(length);')
+                readLines.append('    if (length > 0)')
+                readLines.append('    {')
+                readLines.append('        %s *item = %s_alloc(scratch, sizeof(%s), KTV_GEN_ALIGNOF(%s));' % (subName, prefix, subName, subName))
+                readLines.append('        if (item == NULL || %s_read(item, src + pos, length, scratch) != 0)' % (subName))
+                readLines.append('        {')
+                readLines.append('            return -1;')
+                readLines.append('        }')
+                readLines.append('        value->%s = item;' % (member))
+                readLines.append('    }')
+                readLines.append('    pos += length;')
+                readLines.append('}')
+            else:
+                subName = structName(fieldType)
+                members += '    uint16_t %s_count;\n' % (member)
+                members += '    const %s *%s;\n' % (subName, member)
+                fixedSize += 2
+                sizeLines.append('for (size_t i = 0; i < value->%s_count; i++)' % (member))
+                sizeLines.append('{')
+                sizeLines.append('    size += 2 + %s_encoded_size(&value->%s[i]);' % (subName, member))
+                sizeLines.append('}')
+                writeLines.append('%s_put2(dst, value->%s_count);' % (prefix, member))
+                writeLines.append('dst += 2;')
+                writeLines.append('for (size_t i = 0; i < value->%s_count; i++)' % (member))
+                writeLines.append('{')
+                writeLines.append('    uint8_t *start = dst + 2;')
+                writeLines.append('    uint8_t *end = %s_write(&value->%s[i], start);' % (subName, member))
+                writeLines.append('    %s_put2(dst, (uint16_t)(end - start));' % (prefix))
+                writeLines.append('    dst = end;')
+                writeLines.append('}')
+                readLines.append('KTV_GEN_NEED(2);')
+                readLines.append('value->%s_count = %s_get2(src + pos);' % (member, prefix))
+                readLines.append('pos += 2;')
+                readLines.append('if (value->%s_count > 0)' % (member))
+                readLines.append('{')
+                readLines.append('    %s *items = %s_alloc(scratch, sizeof(%s) * value->%s_count, KTV_GEN_ALIGNOF(%s));' % (subName, prefix, subName, member, subName))
+                readLines.append('    if (items == NULL)')
+                readLines.append('    {')
+                readLines.append('        return -1;')
+                readLines.append('    }')
+                readLines.append('    for (size_t i = 0; i < value->%s_count; i++)' % (member))
+                readLines.append('    {')
+                readLines.append('        KTV_GEN_NEED(2);')
+                readLines.append('        size_t length = %s_get2(src + pos);' % (prefix))
+                readLines.append('        pos += 2;')
+                readLines.append('        KTV_GEN_NEED(length);')
+                readLines.append('        if (%s_read(&items[i], src + pos, length, scratch) != 0)' % (subName))
+                readLines.append('        {')
+                readLines.append('            return -1;')
+                readLines.append('        }')
+                readLines.append('        pos += length;')
+                readLines.append('    }')
+                readLines.append('    value->%s = items;' % (member))
+                readLines.append('}')
+        structs += 'struct %s\n{\n%s};\n\n' % (name, members)
+        functions += C_FUNCTIONS_TEMPLATE % {'model': modelName, 'name': name, 'prefix': prefix} + '\n'
+        declarations += 'static uint8_t *%s_write(const %s *value, uint8_t *dst);\n' % (name, name)
+        declarations += 'static int %s_read(%s *value, const uint8_t *src, size_t size, %s_scratch *scratch);\n' % (name, name, prefix)
+        indent = lambda lines: ''.join(['    %s\n' % (line) if len(line) > 0 else '\n' for line in lines])
+        bodies += 'size_t %s_encoded_size(const %s *value)\n{\n' % (name, name)
+        bodies += indent(['size_t size = %d;' % (fixedSize)] + sizeLines + ['return size;'])
+        bodies += '}\n\n'
+        bodies += 'static uint8_t *%s_write(const %s *value, uint8_t *dst)\n{\n' % (name, name)
+        bodies += indent(writeLines + ['return dst;'])
+        bodies += '}\n\n'
+        bodies += 'static int %s_read(%s *value, const uint8_t *src, size_t size, %s_scratch *scratch)\n{\n' % (name, name, prefix)
+        bodies += indent(['size_t pos = 0;', '(void)scratch;', 'memset(value, 0, sizeof(*value));'] + readLines + ['return 0;'])
+        bodies += '}\n\n'
+        bodies += 'size_t %s_encode(const %s *value, uint8_t *dst, size_t capacity)\n{\n' % (name, name)
+        bodies += indent(['size_t size = %s_encoded_size(value);' % (name),
+                          'if (size > capacity)', '{', '    return 0;', '}',
+                          '%s_write(value, dst);' % (name), 'return size;'])
+        bodies += '}\n\n'
+        bodies += 'int %s_decode(%s *value, const uint8_t *src, size_t size, %s_scratch *scratch)\n{\n' % (name, name, prefix)
+        bodies += indent(['return %s_read(value, src, size, scratch);' % (name)])
+        bodies += '}\n\n'
+
+    guard = re.sub(r'[^0-9a-zA-Z_]', '_', header)
+    dst = open('%s.h' % (fileName), 'w')
+    dst.write(C_HEADER_TEMPLATE % {'source': source, 'guard': guard, 'prefix': prefix,
+                                   'typedefs': typedefs, 'structs': structs, 'functions': functions})
+    dst.close()
+    dst = open('%s.c' % (fileName), 'w')
+    dst.write(C_SOURCE_TEMPLATE % {'source': source, 'header': header, 'prefix': prefix,
+                                   'declarations': declarations, 'bodies': bodies.rstrip('\n') + '\n'})
+    dst.close()
+
 
 def toPrintableBytes(array):
     return [hex(value) for value in array]
 
 
 if __name__ == "__main__":
-    if len(sys.argv) != 2:
-        print "Usage: python %s proto_file_path" % (sys.argv[0])
+    if len(sys.argv) not in (2, 3) or (len(sys.argv) == 3 and sys.argv[2] != OPTION_C):
+        print("Usage: python %s proto_file_path [%s]" % (sys.argv[0], OPTION_C))
     else:
         fileName = sys.argv[1]
         src = open(fileName, 'r')
         lines = src.readlines()
-        result = parse(lines)
+        models = parseModels(lines)
+        result = encode(models)
         src.close()
         dst = open('%s.bin' % (fileName), 'wb')
         dst.write(bytearray(result))
         dst.close()
+        if len(sys.argv) == 3:
+            generateC(fileName, models)
@@ -2,7 +2,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 #include "ktv.h"
+#include "ktv_test_common.h"
+
+#define TEST_THREADS 4
 
 void print_buffer(uint8_t *buffer, size_t size)
 {
@@ -14,39 +18,19 @@ void print_buffer(uint8_t *buffer, size_t size)
     }
 }
 
-void codec_test_with_output(ktv_tree *tree)
+size_t count_set_fields(ktv_obj *obj)
 {
-    ktv_obj *user = ktv_obj_new(tree, "user");
-    ktv_obj_set_byte(user, "age", 30);
-    ktv_obj_set_byte(user, "gender", 1);
-
-    ktv_obj *job = ktv_obj_new(tree, "job");
-    char *title = "Product Manager";
-    ktv_array *title_array = ktv_array_new_string(job, "title", title, strlen(title));
-    ktv_obj_set_array(job, "title", title_array);
-    ktv_obj_set_byte(job, "type", 2);
-
-    ktv_obj_set_obj(user, "job", job);
-
-    ktv_obj *task1 = ktv_obj_new(tree, "task");
-    ktv_obj_set_int2(task1, "id", 10001);
-    ktv_obj_set_byte(task1, "status", 3);
-    ktv_obj *task2 = ktv_obj_new(tree, "task");
-    ktv_obj_set_int2(task2, "id", -10002);
-    ktv_obj_set_byte(task2, "status", 2);
-    int32_t task2_times[2] = {1234567, -7654321};
-    ktv_array *task2_time_array = ktv_array_new_int4s(task2, "time", task2_times, 2);
-    ktv_obj_set_array(task2, "time", task2_time_array);
-    ktv_array *task_array = ktv_array_new_objs(user, "tasks", 2);
-    ktv_array_set_obj(task_array, 0, task1);
-    ktv_array_set_obj(task_array, 1, task2);
-
-    ktv_obj_set_array(user, "tasks", task_array);
-
-    char *name = "Zhang Ji";
-    ktv_array *name_array = ktv_array_new_string(user, "name", name, strlen(name));
-    ktv_obj_set_array(user, "name", name_array);
+    size_t count = 0;
+    for (size_t i = 0; i < obj->tree->models[obj->model_index]->field_count; i++)
+    {
+        count += ktv_obj_get_value_by_index(obj, i) != NULL;
+    }
+    return count;
+}
 
+void codec_test_with_output(ktv_tree *tree)
+{
+    ktv_obj *user = new_test_user(tree);
     ktv_print_obj(user);
 
     printf("\n=== User Object Encode ===\n");
@@ -64,10 +48,8 @@ void codec_test_with_output(ktv_tree *tree)
     ktv_obj_delete(user);
 }
 
-void benchmark_test(ktv_tree *tree, int repeat)
+ktv_obj *new_test_address_book(ktv_tree *tree)
 {
-    clock_t start, stop;
-
     ktv_obj *person_alice = ktv_obj_new(tree, "Person");
     ktv_obj_set_array(person_alice, "name", ktv_array_new_string(person_alice, "name", "Alice", 5));
     ktv_obj_set_int4(person_alice, "id", 10000);
@@ -84,7 +66,7 @@ void benchmark_test(ktv_tree *tree, int repeat)
 
     ktv_obj *person_bob = ktv_obj_new(tree, "Person");
     ktv_obj_set_array(person_bob, "name", ktv_array_new_string(person_alice, "name", "Bob", 3));
-    ktv_obj_set_int2(person_bob, "id", 20000);
+    ktv_obj_set_int4(person_bob, "id", 20000);
     ktv_obj *number3 = ktv_obj_new(tree, "PhoneNumber");
     ktv_obj_set_array(number3, "number", ktv_array_new_string(number1, "number", "0123456789", 10));
     ktv_obj_set_byte(number3, "type", 3);
@@ -97,7 +79,1008 @@ void benchmark_test(ktv_tree *tree, int repeat)
     ktv_array_set_obj(person, 0, person_alice);
     ktv_array_set_obj(person, 1, person_bob);
     ktv_obj_set_array(address_book, "person", person);
+    return address_book;
+}
+
+void encode_into_test(ktv_tree *tree)
+{
+    printf("\n=== Encode Into Caller Memory ===\n");
+    ktv_obj *user = new_test_user(tree);
+    ktv_buffer *expected = ktv_obj_encode(user);
+    uint8_t dst[256];
+    size_t size = ktv_obj_encoded_size(user);
+    printf("Encoded Size: %zu\n", size);
+    print_result("encode_into", ktv_obj_encode_into(user, dst, sizeof(dst)) == size &&
+                                    size == expected->size &&
+                                    memcmp(dst, expected->buffer, size) == 0);
+    print_result("encode_into overflow", ktv_obj_encode_into(user, dst, size - 1) == 0);
+    ktv_buffer_delete(expected);
+    ktv_obj_delete(user);
+}
+
+void buffer_reuse_test(ktv_tree *tree)
+{
+    printf("\n=== Buffer Reuse ===\n");
+    ktv_obj *user = new_test_user(tree);
+    ktv_buffer *expected = ktv_obj_encode(user);
+    ktv_buffer *buffer = ktv_buffer_new(NULL, 0);
+    ktv_buffer_reserve(buffer, 1024);
+    uint8_t *storage = buffer->buffer;
+    int ok = 1;
+    for (int i = 0; i < 10; i++)
+    {
+        ktv_buffer_clear(buffer);
+        ok = ok && ktv_obj_encode_append(user, buffer) == expected->size &&
+             memcmp(buffer->buffer, expected->buffer, expected->size) == 0;
+    }
+    print_result("encode_append", ok);
+    print_result("storage reused", buffer->buffer == storage && buffer->capacity == 1024);
+    ktv_obj_encode_append(user, buffer);
+    print_result("append after", buffer->size == expected->size * 2 &&
+                                     memcmp(buffer->buffer + expected->size, expected->buffer, expected->size) == 0);
+    ktv_buffer_delete(buffer);
+    ktv_buffer_delete(expected);
+    ktv_obj_delete(user);
+}
+
+void encode_iov_test(ktv_tree *tree)
+{
+    printf("\n=== Encode IOV ===\n");
+    ktv_obj *user = new_test_user(tree);
+    char description[200];
+    memset(description, 'x', sizeof(description));
+    ktv_obj *job = ktv_obj_get_obj(user, "job");
+    ktv_array_delete(ktv_obj_get_array(job, "title"));
+    ktv_array *title = ktv_array_new_string(job, "title", description, sizeof(description));
+    ktv_obj_set_array(job, "title", title);
+    ktv_buffer *expected = ktv_obj_encode(user);
+
+    uint8_t scratch[128];
+    ktv_iovec iov[8];
+    size_t iov_count = 8;
+    size_t size = ktv_obj_encode_iov(user, scratch, sizeof(scratch), iov, &iov_count);
+    printf("Encoded Size: %zu, IOV Count: %zu\n", size, iov_count);
+    uint8_t joined[512];
+    size_t joined_size = 0;
+    int referenced = 0;
+    for (size_t i = 0; i < iov_count; i++)
+    {
+        memcpy(joined + joined_size, iov[i].iov_base, iov[i].iov_len);
+        joined_size += iov[i].iov_len;
+        referenced = referenced || iov[i].iov_base == title->values;
+    }
+    print_result("encode_iov", size == expected->size && joined_size == size &&
+                                   memcmp(joined, expected->buffer, size) == 0);
+    print_result("payload referenced", referenced);
+    iov_count = 1;
+    print_result("encode_iov overflow", ktv_obj_encode_iov(user, scratch, sizeof(scratch), iov, &iov_count) == 0);
+    ktv_buffer_delete(expected);
+    ktv_obj_delete(user);
+}
+
+int collect_chunk(void *context, const uint8_t *data, size_t size)
+{
+    ktv_buffer *buffer = (ktv_buffer *)context;
+    ktv_buffer_append(buffer, (uint8_t *)data, size);
+    return 0;
+}
+
+void encode_stream_test(ktv_tree *tree)
+{
+    printf("\n=== Encode Stream ===\n");
+    ktv_obj *address_book = new_test_address_book(tree);
+    ktv_buffer *expected = ktv_obj_encode(address_book);
+    ktv_buffer *streamed = ktv_buffer_new(NULL, 0);
+    uint8_t chunk[7];
+    size_t size = ktv_obj_encode_stream(address_book, chunk, sizeof(chunk), collect_chunk, streamed);
+    printf("Encoded Size: %zu\n", size);
+    print_result("encode_stream", size == expected->size && streamed->size == size &&
+                                      memcmp(streamed->buffer, expected->buffer, size) == 0);
+    ktv_buffer_delete(streamed);
+    ktv_buffer_delete(expected);
+    ktv_obj_delete(address_book);
+
+    // mentor chain, every level carries a length prefix sized up front
+    ktv_obj *user = new_test_user(tree);
+    ktv_obj *mentee = user;
+    for (int i = 0; i < 4; i++)
+    {
+        ktv_obj *mentor = new_test_user(tree);
+        ktv_array *mentors = ktv_array_new_objs(mentee, "mentor", 1);
+        ktv_array_set_obj(mentors, 0, mentor);
+        ktv_obj_set_array(mentee, "mentor", mentors);
+        mentee = mentor;
+    }
+    expected = ktv_obj_encode(user);
+    streamed = ktv_buffer_new(NULL, 0);
+    size = ktv_obj_encode_stream(user, chunk, sizeof(chunk), collect_chunk, streamed);
+    print_result("encode_stream nested", size > 5 * 40 && size == expected->size && streamed->size == size &&
+                                             memcmp(streamed->buffer, expected->buffer, size) == 0);
+    ktv_buffer_delete(streamed);
+    ktv_buffer_delete(expected);
+    ktv_obj_delete(user);
+}
+
+ktv_obj *new_test_task(ktv_tree *tree, size_t count)
+{
+    ktv_obj *task = ktv_obj_new(tree, "task");
+    ktv_obj_set_int2(task, "id", 1);
+    ktv_obj_set_byte(task, "status", 0);
+    int32_t *times = malloc(sizeof(int32_t) * count);
+    for (size_t i = 0; i < count; i++)
+    {
+        times[i] = (int32_t)(i * 2654435761u);
+    }
+    ktv_obj_set_array(task, "time", ktv_array_new_int4s(task, "time", times, count));
+    free(times);
+    return task;
+}
+
+void int_array_codec_test(ktv_tree *tree)
+{
+    printf("\n=== Int Array Codec ===\n");
+    int ok = 1;
+    for (size_t count = 1; count < 40; count++)
+    {
+        ktv_obj *task = new_test_task(tree, count);
+        ktv_buffer *buffer = ktv_obj_encode(task);
+        int32_t *times = ktv_array_get_int4s(ktv_obj_get_array(task, "time"));
+        for (size_t i = 0; i < count; i++)
+        {
+            uint8_t *bytes = buffer->buffer + 5 + i * 4;
+            uint32_t value = (uint32_t)bytes[0] << 24 | bytes[1] << 16 | bytes[2] << 8 | bytes[3];
+            ok = ok && (int32_t)value == times[i];
+        }
+        ktv_obj *decoded = ktv_obj_new(tree, "task");
+        ktv_obj_decode(decoded, buffer);
+        ktv_array *decoded_times = ktv_obj_get_array(decoded, "time");
+        ok = ok && decoded_times->count == count &&
+             memcmp(ktv_array_get_int4s(decoded_times), times, count * sizeof(int32_t)) == 0;
+        ktv_obj_delete(decoded);
+        ktv_buffer_delete(buffer);
+        ktv_obj_delete(task);
+    }
+    print_result("int4 array big endian", ok);
+
+    // one model with a single int2 array field, the test proto has none
+    uint8_t proto[] = {1, 6, 's', 'a', 'm', 'p', 'l', 'e', 1, 6, 'v', 'a', 'l', 'u', 'e', 's', KTV_TARRAY, KTV_TINT2};
+    ktv_tree *sample_tree = ktv_tree_new(proto, sizeof(proto));
+    ok = 1;
+    for (size_t count = 1; count < 40; count++)
+    {
+        ktv_obj *sample = ktv_obj_new(sample_tree, "sample");
+        int16_t *values = malloc(sizeof(int16_t) * count);
+        for (size_t i = 0; i < count; i++)
+        {
+            values[i] = (int16_t)(i * 40503u);
+        }
+        ktv_obj_set_array(sample, "values", ktv_array_new_int2s(sample, "values", values, count));
+        ktv_buffer *buffer = ktv_obj_encode(sample);
+        for (size_t i = 0; i < count; i++)
+        {
+            uint8_t *bytes = buffer->buffer + 2 + i * 2;
+            ok = ok && (int16_t)(bytes[0] << 8 | bytes[1]) == values[i];
+        }
+        ktv_obj *decoded = ktv_obj_new(sample_tree, "sample");
+        ktv_obj_decode(decoded, buffer);
+        ktv_array *decoded_values = ktv_obj_get_array(decoded, "values");
+        ok = ok && decoded_values->count == count &&
+             memcmp(ktv_array_get_int2s(decoded_values), values, count * sizeof(int16_t)) == 0;
+        ktv_obj_delete(decoded);
+        ktv_buffer_delete(buffer);
+        ktv_obj_delete(sample);
+        free(values);
+    }
+    print_result("int2 array big endian", ok);
+    ktv_tree_delete(sample_tree);
+}
+
+void truncated_decode_test(ktv_tree *tree)
+{
+    printf("\n=== Truncated Decode ===\n");
+    ktv_obj *task = new_test_task(tree, 2);
+    ktv_obj_set_int2(task, "id", 300);
+    ktv_obj_set_byte(task, "status", 7);
+    ktv_buffer *buffer = ktv_obj_encode(task);
+    // keep id & status, drop time
+    buffer->size = 3;
+    ktv_obj *decoded = ktv_obj_new(tree, "task");
+    ktv_obj_decode(decoded, buffer);
+    print_result("truncated after block", ktv_obj_get_int2(decoded, "id") == 300 &&
+                                              ktv_obj_get_byte(decoded, "status") == 7 &&
+                                              ktv_obj_get_array(decoded, "time") == NULL);
+    ktv_obj_delete(decoded);
+    // keep id only
+    buffer->size = 2;
+    decoded = ktv_obj_new(tree, "task");
+    ktv_obj_decode(decoded, buffer);
+    print_result("truncated inside block", ktv_obj_get_int2(decoded, "id") == 300 &&
+                                               count_set_fields(decoded) == 1);
+    ktv_obj_delete(decoded);
+    // cut inside id
+    buffer->size = 1;
+    decoded = ktv_obj_new(tree, "task");
+    ktv_obj_decode(decoded, buffer);
+    print_result("truncated inside field", count_set_fields(decoded) == 0);
+    ktv_obj_delete(decoded);
+
+    // time count claims more values than the input has, copied to an exact size buffer
+    ktv_buffer *cut = ktv_buffer_new(buffer->buffer, 7);
+    cut->buffer[3] = 0xFF;
+    decoded = ktv_obj_new(tree, "task");
+    ktv_obj_decode(decoded, cut);
+    print_result("truncated inside array", ktv_obj_get_byte(decoded, "status") == 7 &&
+                                               ktv_obj_get_array(decoded, "time") == NULL);
+    ktv_obj_delete(decoded);
+    ktv_buffer_delete(cut);
+    // tasks count of a user claims more elements than there are prefixes
+    ktv_obj *user = new_test_user(tree);
+    ktv_buffer *user_buffer = ktv_obj_encode(user);
+    size_t tasks_at = 4 + (user_buffer->buffer[2] << 8 | user_buffer->buffer[3]);
+    cut = ktv_buffer_new(user_buffer->buffer, tasks_at + 4);
+    cut->buffer[tasks_at] = 0xFF;
+    decoded = ktv_obj_new(tree, "user");
+    ktv_obj_decode(decoded, cut);
+    print_result("hostile model array count", ktv_obj_get_byte(decoded, "age") == 30 &&
+                                                  ktv_obj_get_array(decoded, "tasks") == NULL);
+    ktv_obj_delete(decoded);
+    ktv_buffer_delete(cut);
+    ktv_buffer_delete(user_buffer);
+    ktv_obj_delete(user);
+    ktv_buffer_delete(buffer);
+    ktv_obj_delete(task);
+}
+
+void encode_batch_test(ktv_tree *tree)
+{
+    printf("\n=== Encode Batch ===\n");
+    ktv_obj *tasks[3];
+    for (size_t i = 0; i < 3; i++)
+    {
+        tasks[i] = new_test_task(tree, i * 3);
+    }
+    size_t offsets[3];
+    ktv_buffer *batch = ktv_encode_batch(tasks, 3, offsets);
+    printf("Batch Size: %zu\n", batch->size);
+    int ok = 1;
+    size_t expected_size = 0;
+    for (size_t i = 0; i < 3; i++)
+    {
+        ktv_buffer *expected = ktv_obj_encode(tasks[i]);
+        uint8_t *frame = batch->buffer + offsets[i] - 2;
+        ok = ok && offsets[i] == expected_size + 2 &&
+             (size_t)(frame[0] << 8 | frame[1]) == expected->size &&
+             memcmp(batch->buffer + offsets[i], expected->buffer, expected->size) == 0;
+        expected_size += 2 + expected->size;
+        ktv_buffer_delete(expected);
+        ktv_obj_delete(tasks[i]);
+    }
+    print_result("encode_batch", ok && batch->size == expected_size && batch->capacity == expected_size);
+    ktv_buffer_delete(batch);
+
+    // 16384 int4 times encode to more than 65535 bytes
+    ktv_obj *large[2] = {new_test_task(tree, 1), new_test_task(tree, 16384)};
+    print_result("encode_batch oversize", ktv_encode_batch(large, 2, offsets) == NULL);
+    ktv_obj_delete(large[1]);
+    ktv_obj_delete(large[0]);
+}
+
+typedef struct thread_executor_job
+{
+    ktv_task task;
+    void *argument;
+    size_t count;
+    size_t first;
+    size_t step;
+} thread_executor_job;
+
+void *thread_executor_worker(void *argument)
+{
+    thread_executor_job *job = (thread_executor_job *)argument;
+    for (size_t i = job->first; i < job->count; i += job->step)
+    {
+        job->task(job->argument, i);
+    }
+    return NULL;
+}
+
+void thread_executor(void *context, ktv_task task, void *argument, size_t count)
+{
+    size_t threads = *(size_t *)context;
+    pthread_t workers[threads];
+    thread_executor_job jobs[threads];
+    for (size_t t = 0; t < threads; t++)
+    {
+        thread_executor_job job = {task, argument, count, t, threads};
+        jobs[t] = job;
+        pthread_create(&workers[t], NULL, thread_executor_worker, &jobs[t]);
+    }
+    for (size_t t = 0; t < threads; t++)
+    {
+        pthread_join(workers[t], NULL);
+    }
+}
+
+ktv_obj *new_test_large_address_book(ktv_tree *tree, uint16_t count)
+{
+    ktv_obj *address_book = ktv_obj_new(tree, "AddressBook");
+    ktv_array *person = ktv_array_new_objs(address_book, "person", count);
+    for (uint16_t i = 0; i < count; i++)
+    {
+        char name[32];
+        int length = sprintf(name, "Person %u", i);
+        ktv_obj *item = ktv_obj_new(tree, "Person");
+        ktv_obj_set_array(item, "name", ktv_array_new_string(item, "name", name, length));
+        ktv_obj_set_int4(item, "id", i);
+        ktv_obj *number = ktv_obj_new(tree, "PhoneNumber");
+        ktv_obj_set_array(number, "number", ktv_array_new_string(number, "number", name, length));
+        ktv_obj_set_byte(number, "type", i % 3);
+        ktv_array *phone = ktv_array_new_objs(item, "phone", 1);
+        ktv_array_set_obj(phone, 0, number);
+        ktv_obj_set_array(item, "phone", phone);
+        ktv_array_set_obj(person, i, item);
+    }
+    ktv_obj_set_array(address_book, "person", person);
+    return address_book;
+}
+
+void encode_parallel_test(ktv_tree *tree)
+{
+    printf("\n=== Encode Parallel ===\n");
+    size_t threads = TEST_THREADS;
+    ktv_obj *address_book = new_test_large_address_book(tree, 1000);
+    ktv_buffer *expected = ktv_obj_encode(address_book);
+    ktv_buffer *buffer = ktv_obj_encode_parallel(address_book, thread_executor, &threads);
+    printf("Encoded Size: %zu\n", buffer->size);
+    print_result("encode_parallel", buffer->size == expected->size &&
+                                        memcmp(buffer->buffer, expected->buffer, buffer->size) == 0);
+    ktv_buffer_delete(buffer);
+    ktv_buffer_delete(expected);
+    ktv_obj_delete(address_book);
+}
+
+void view_test(ktv_tree *tree)
+{
+    printf("\n=== View ===\n");
+    ktv_obj *user = new_test_user(tree);
+    ktv_buffer *buffer = ktv_obj_encode(user);
+
+    ktv_view view = ktv_view_new(tree, "user", buffer->buffer, buffer->size);
+    print_result("scalar", ktv_view_get_byte(&view, "age") == 30 && ktv_view_get_byte(&view, "gender") == 1);
+    uint16_t count = 0;
+    const char *name = ktv_view_get_string(&view, "name", &count);
+    print_result("string in place", count == 8 && memcmp(name, "Zhang Ji", count) == 0 &&
+                                        (const uint8_t *)name > buffer->buffer &&
+                                        (const uint8_t *)name < buffer->buffer + buffer->size);
+
+    ktv_view job = ktv_view_get_obj(&view, "job");
+    const char *title = ktv_view_get_string(&job, "title", &count);
+    print_result("nested view", count == 15 && memcmp(title, "Product Manager", count) == 0 &&
+                                    ktv_view_get_byte(&job, "type") == 2);
+
+    ktv_view task = ktv_view_get_obj_at(&view, "tasks", 1);
+    print_result("model array view", ktv_view_get_count(&view, "tasks") == 2 &&
+                                         ktv_view_get_int2(&task, "id") == -10002 &&
+                                         ktv_view_get_count(&task, "time") == 2 &&
+                                         ktv_view_get_int4_at(&task, "time", 1) == -7654321);
+
+    ktv_view truncated = ktv_view_new(tree, "user", buffer->buffer, 3);
+    ktv_view missing = ktv_view_get_obj_at(&view, "tasks", 2);
+    print_result("missing fields", ktv_view_get_byte(&truncated, "gender") == 1 &&
+                                       ktv_view_get_string(&truncated, "name", &count) == NULL && count == 0 &&
+                                       missing.data == NULL && ktv_view_get_int2(&missing, "id") == 0);
+
+    ktv_buffer_delete(buffer);
+    ktv_obj_delete(user);
+}
+
+void set_by_index_test(ktv_tree *tree)
+{
+    printf("\n=== Set By Index ===\n");
+    ktv_obj *user = ktv_obj_new(tree, "user");
+    uint8_t age = ktv_obj_field_index(user, "age");
+    ktv_obj_set_byte_by_index(user, age, 30);
+    ktv_obj_set_int4_by_index(user, age, 1);
+    ktv_obj_set_byte_by_index(user, 0xFF, 1);
+    print_result("set_byte_by_index", ktv_obj_get_byte(user, "age") == 30 && count_set_fields(user) == 1 &&
+                                          ktv_obj_field_index(user, "unknown") == 0xFF);
+    ktv_obj *job = ktv_obj_new(tree, "job");
+    ktv_obj_set_obj_by_index(user, ktv_obj_field_index(user, "job"), job);
+    print_result("set_obj_by_index", ktv_obj_get_obj(user, "job") == job);
+    ktv_obj_delete(user);
+}
+
+void validate_test(ktv_tree *tree)
+{
+    printf("\n=== Validate ===\n");
+    ktv_obj *user = new_test_user(tree);
+    ktv_buffer *buffer = ktv_obj_encode(user);
+    ktv_verified verified;
+    int result = ktv_validate(tree, "user", buffer->buffer, buffer->size, &verified);
+    ktv_obj *decoded = ktv_obj_new(tree, "user");
+    ktv_obj_decode_verified(decoded, &verified);
+    ktv_buffer *reencoded = ktv_obj_encode(decoded);
+    print_result("valid", result == 0 && reencoded->size == buffer->size &&
+                              memcmp(reencoded->buffer, buffer->buffer, buffer->size) == 0);
+    ktv_buffer_delete(reencoded);
+    ktv_obj_delete(decoded);
+
+    // age & gender, then end at field boundary
+    print_result("truncated at field", ktv_validate(tree, "user", buffer->buffer, 2, &verified) == 0);
+    print_result("truncated inside field", ktv_validate(tree, "user", buffer->buffer, 3, &verified) == -1);
+    print_result("truncated inside nested", ktv_validate(tree, "user", buffer->buffer, 10, &verified) == -1);
+    // job length claims more bytes than the input has
+    buffer->buffer[2] = 0xFF;
+    print_result("malformed length", ktv_validate(tree, "user", buffer->buffer, buffer->size, &verified) == -1);
+    print_result("unknown model", ktv_validate(tree, "unknown", buffer->buffer, buffer->size, &verified) == -1);
+    ktv_buffer_delete(buffer);
+    ktv_obj_delete(user);
+}
+
+void decode_fields_test(ktv_tree *tree)
+{
+    printf("\n=== Decode Fields ===\n");
+    ktv_obj *user = new_test_user(tree);
+    ktv_buffer *buffer = ktv_obj_encode(user);
+    ktv_mask *mask = ktv_mask_new(tree);
+    int result = ktv_mask_add(mask, "user", "name") | ktv_mask_add(mask, "user", "age") |
+                 ktv_mask_add(mask, "user", "tasks.time");
+    print_result("mask_add", result == 0 && ktv_mask_add(mask, "user", "name.x") == -1 &&
+                                 ktv_mask_add(mask, "user", "unknown") == -1);
+
+    ktv_obj *decoded = ktv_obj_new(tree, "user");
+    ktv_obj_decode_fields(decoded, buffer, mask);
+    ktv_array *name = ktv_obj_get_array(decoded, "name");
+    ktv_array *tasks = ktv_obj_get_array(decoded, "tasks");
+    ktv_obj *task = ktv_array_get_obj(tasks, 1);
+    print_result("decode_fields", ktv_obj_get_byte(decoded, "age") == 30 && name != NULL &&
+                                      memcmp(ktv_array_get_string(name), "Zhang Ji", 8) == 0 &&
+                                      ktv_obj_get_obj(decoded, "job") == NULL && count_set_fields(decoded) == 3 &&
+                                      count_set_fields(task) == 1 &&
+                                      ktv_array_get_int4s(ktv_obj_get_array(task, "time"))[1] == -7654321);
+    ktv_obj_delete(decoded);
+
+    ktv_mask_add(mask, "user", "job");
+    decoded = ktv_obj_new(tree, "user");
+    ktv_obj_decode_fields(decoded, buffer, mask);
+    ktv_obj *job = ktv_obj_get_obj(decoded, "job");
+    print_result("whole nested model", job != NULL && ktv_obj_get_byte(job, "type") == 2 && count_set_fields(job) == 2);
+    ktv_obj_delete(decoded);
+    ktv_mask_delete(mask);
+    ktv_buffer_delete(buffer);
+
+    // tasks.time selects user.tasks first, a later whole mentor must still select every task field
+    ktv_array *mentors = ktv_array_new_objs(user, "mentor", 1);
+    ktv_array_set_obj(mentors, 0, new_test_user(tree));
+    ktv_obj_set_array(user, "mentor", mentors);
+    buffer = ktv_obj_encode(user);
+    mask = ktv_mask_new(tree);
+    ktv_mask_add(mask, "user", "tasks.time");
+    ktv_mask_add(mask, "user", "mentor");
+    decoded = ktv_obj_new(tree, "user");
+    ktv_obj_decode_fields(decoded, buffer, mask);
+    ktv_obj *mentor = ktv_array_get_obj(ktv_obj_get_array(decoded, "mentor"), 0);
+    task = ktv_array_get_obj(ktv_obj_get_array(mentor, "tasks"), 1);
+    print_result("path then whole model", mentor != NULL && ktv_obj_get_byte(mentor, "age") == 30 &&
+                                              ktv_obj_get_int2(task, "id") == -10002 &&
+                                              ktv_obj_get_byte(task, "status") == 2 && count_set_fields(task) == 3);
+    ktv_obj_delete(decoded);
+
+    ktv_mask_delete(mask);
+    ktv_buffer_delete(buffer);
+    ktv_obj_delete(user);
+}
+
+void array_index_test(ktv_tree *tree)
+{
+    printf("\n=== Array Index ===\n");
+    ktv_obj *address_book = new_test_large_address_book(tree, 1000);
+    ktv_buffer *buffer = ktv_obj_encode(address_book);
+    ktv_array *person = ktv_obj_get_array(address_book, "person");
+
+    ktv_view view = ktv_view_new(tree, "AddressBook", buffer->buffer, buffer->size);
+    ktv_array_index *array_index = ktv_array_index_new(&view, "person");
+    ktv_view element = ktv_array_index_view(array_index, 500);
+    print_result("index view", array_index->count == 1000 &&
+                                   ktv_view_get_int4(&element, "id") ==
+                                       ktv_obj_get_int4(ktv_array_get_obj(person, 500), "id"));
 
+    ktv_obj *objs[8];
+    uint16_t count = ktv_array_index_decode_range(array_index, 996, 8, objs);
+    int ok = count == 4;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        ok = ok && ktv_obj_get_int4(objs[i], "id") == ktv_obj_get_int4(ktv_array_get_obj(person, 996 + i), "id");
+        ktv_obj_delete(objs[i]);
+    }
+    print_result("index decode range", ok && ktv_array_index_decode(array_index, 1000) == NULL);
+    ktv_array_index_delete(array_index);
+
+    // keep the first element and a half of the second
+    view.size = 2 + 2 + (uint16_t)((buffer->buffer[2] << 8) | buffer->buffer[3]) + 4;
+    array_index = ktv_array_index_new(&view, "person");
+    print_result("index truncated", array_index->count == 1);
+    ktv_array_index_delete(array_index);
+
+    ktv_buffer_delete(buffer);
+    ktv_obj_delete(address_book);
+}
+
+void push_decoder_test(ktv_tree *tree)
+{
+    printf("\n=== Push Decoder ===\n");
+    ktv_obj *user = new_test_user(tree);
+    ktv_buffer *expected = ktv_obj_encode(user);
+    // two messages back to back
+    ktv_buffer *stream = ktv_buffer_new(expected->buffer, expected->size);
+    ktv_buffer_append(stream, expected->buffer, expected->size);
+
+    ktv_decoder *decoder = ktv_decoder_new(tree, "user");
+    int ok = 1;
+    for (size_t fragment = 1; fragment <= 20; fragment++)
+    {
+        size_t messages = 0;
+        size_t index = 0;
+        while (index < stream->size)
+        {
+            size_t size = stream->size - index < fragment ? stream->size - index : fragment;
+            size_t consumed = 0;
+            while (consumed < size)
+            {
+                consumed += ktv_decoder_feed(decoder, stream->buffer + index + consumed, size - consumed);
+                ktv_obj *decoded = ktv_decoder_take(decoder);
+                if (decoded == NULL)
+                {
+                    continue;
+                }
+                ktv_buffer *buffer = ktv_obj_encode(decoded);
+                ok = ok && buffer->size == expected->size && memcmp(buffer->buffer, expected->buffer, buffer->size) == 0;
+                ktv_buffer_delete(buffer);
+                ktv_obj_delete(decoded);
+                messages++;
+            }
+            index += size;
+        }
+        ok = ok && messages == 2;
+    }
+    print_result("feed fragments", ok);
+
+    // cut in the middle of "name"
+    ktv_decoder_feed(decoder, expected->buffer, expected->size - 3);
+    ktv_obj *decoded = ktv_decoder_finish(decoder);
+    print_result("finish truncated", ktv_decoder_take(decoder) == NULL && ktv_obj_get_byte(decoded, "age") == 30 &&
+                                         ktv_obj_get_array(decoded, "tasks") != NULL &&
+                                         ktv_obj_get_array(decoded, "name") == NULL);
+    ktv_obj_delete(decoded);
+
+    ktv_decoder_feed(decoder, expected->buffer, 7);
+    ktv_decoder_delete(decoder);
+    ktv_buffer_delete(stream);
+    ktv_buffer_delete(expected);
+    ktv_obj_delete(user);
+}
+
+void decode_reuse_test(ktv_tree *tree)
+{
+    printf("\n=== Decode Reuse ===\n");
+    ktv_obj *large = new_test_address_book(tree);
+    ktv_obj *small = new_test_large_address_book(tree, 1);
+    ktv_buffer *large_buffer = ktv_obj_encode(large);
+    ktv_buffer *small_buffer = ktv_obj_encode(small);
+
+    ktv_obj *decoded = ktv_obj_new(tree, "AddressBook");
+    ktv_obj_decode(decoded, large_buffer);
+    ktv_array *person = ktv_obj_get_array(decoded, "person");
+    ktv_obj *first = ktv_array_get_obj(person, 0);
+
+    ktv_obj_reset(decoded);
+    print_result("reset", count_set_fields(decoded) == 0 && ktv_obj_get_array(decoded, "person") == NULL);
+
+    ktv_obj_decode(decoded, small_buffer);
+    ktv_buffer *buffer = ktv_obj_encode(decoded);
+    print_result("decode smaller", ktv_obj_get_array(decoded, "person") == person &&
+                                       ktv_array_get_obj(person, 0) == first && buffer->size == small_buffer->size &&
+                                       memcmp(buffer->buffer, small_buffer->buffer, buffer->size) == 0);
+    ktv_buffer_delete(buffer);
+
+    ktv_obj_reset(decoded);
+    ktv_obj_decode(decoded, large_buffer);
+    buffer = ktv_obj_encode(decoded);
+    print_result("decode larger", ktv_array_get_obj(ktv_obj_get_array(decoded, "person"), 0) == first &&
+                                      buffer->size == large_buffer->size &&
+                                      memcmp(buffer->buffer, large_buffer->buffer, buffer->size) == 0);
+    ktv_buffer_delete(buffer);
+
+    // no reset in between, the populated person array is recycled instead of leaked
+    ktv_obj_decode(decoded, small_buffer);
+    person = ktv_obj_get_array(decoded, "person");
+    buffer = ktv_obj_encode(decoded);
+    print_result("decode populated", ktv_array_get_obj(person, 0) == first && person->capacity > person->count &&
+                                         ktv_array_get_obj(person, person->count) == NULL &&
+                                         buffer->size == small_buffer->size &&
+                                         memcmp(buffer->buffer, small_buffer->buffer, buffer->size) == 0);
+    ktv_buffer_delete(buffer);
+
+    ktv_obj_delete(decoded);
+    ktv_buffer_delete(small_buffer);
+    ktv_buffer_delete(large_buffer);
+    ktv_obj_delete(small);
+    ktv_obj_delete(large);
+}
+
+void decode_parallel_test(ktv_tree *tree)
+{
+    printf("\n=== Decode Parallel ===\n");
+    size_t threads = TEST_THREADS;
+    ktv_obj *address_book = new_test_large_address_book(tree, 1000);
+    ktv_buffer *buffer = ktv_obj_encode(address_book);
+    ktv_obj *decoded = ktv_obj_new(tree, "AddressBook");
+    ktv_obj_decode_parallel(decoded, buffer, thread_executor, &threads);
+    ktv_buffer *reencoded = ktv_obj_encode(decoded);
+    print_result("decode_parallel", reencoded->size == buffer->size &&
+                                        memcmp(reencoded->buffer, buffer->buffer, buffer->size) == 0);
+    ktv_buffer_delete(reencoded);
+    ktv_obj_delete(decoded);
+    ktv_buffer_delete(buffer);
+    ktv_obj_delete(address_book);
+}
+
+void arena_test(ktv_tree *tree)
+{
+    printf("\n=== Arena ===\n");
+    ktv_obj *user = new_test_user(tree);
+    ktv_buffer *buffer = ktv_obj_encode(user);
+    ktv_arena *arena = ktv_arena_new(64);
+    int ok = 1;
+    for (int i = 0; i < 3; i++)
+    {
+        ktv_obj *decoded = ktv_obj_new_in(arena, tree, "user");
+        ktv_obj_decode(decoded, buffer);
+        ktv_buffer *reencoded = ktv_obj_encode(decoded);
+        ok = ok && reencoded->size == buffer->size && memcmp(reencoded->buffer, buffer->buffer, buffer->size) == 0 &&
+             ktv_obj_get_obj(decoded, "job")->arena == arena;
+        ktv_buffer_delete(reencoded);
+        ktv_obj_delete(decoded);
+        ktv_arena_reset(arena);
+    }
+    print_result("arena decode", ok && arena->chunk->next == NULL && arena->chunk->used == 0);
+
+    ktv_obj *job = ktv_obj_new_in(arena, tree, "job");
+    char *title = "Engineer";
+    ktv_obj_set_array(job, "title", ktv_array_new_string(job, "title", title, strlen(title)));
+    ktv_obj_set_byte(job, "type", 1);
+    print_result("arena build", ktv_obj_get_byte(job, "type") == 1 &&
+                                    memcmp(ktv_array_get_string(ktv_obj_get_array(job, "title")), title, 8) == 0);
+
+    ktv_arena_delete(arena);
+    ktv_buffer_delete(buffer);
+    ktv_obj_delete(user);
+}
+
+void field_handle_test(ktv_tree *tree)
+{
+    printf("\n=== Field Handle ===\n");
+    ktv_model_handle user_model = ktv_model_resolve(tree, "user");
+    ktv_field_handle age = ktv_field_resolve(tree, "user", "age");
+    ktv_field_handle job_field = ktv_field_resolve(tree, "user", "job");
+    ktv_field_handle tasks = ktv_field_resolve(tree, "user", "tasks");
+    ktv_field_handle type = ktv_field_resolve(tree, "job", "type");
+    ktv_field_handle id = ktv_field_resolve(tree, "task", "id");
+
+    ktv_obj *user = ktv_obj_new_h(tree, user_model);
+    ktv_obj *job = ktv_obj_new(tree, "job");
+    ktv_obj_set_byte_h(user, age, 30);
+    ktv_obj_set_byte_h(job, type, 2);
+    ktv_obj_set_obj_h(user, job_field, job);
+    ktv_array *task_array = ktv_array_new_objs(user, "tasks", 1);
+    ktv_obj *task = ktv_obj_new(tree, "task");
+    ktv_obj_set_int2_h(task, id, -10001);
+    ktv_array_set_obj(task_array, 0, task);
+    ktv_obj_set_array_h(user, tasks, task_array);
+    print_result("handle set/get", ktv_obj_get_byte_h(user, age) == 30 && ktv_obj_get_byte(user, "age") == 30 &&
+                                       ktv_obj_get_obj_h(user, job_field) == job &&
+                                       ktv_obj_get_byte_h(job, type) == 2 &&
+                                       ktv_obj_get_array_h(user, tasks) == task_array &&
+                                       ktv_obj_get_int2(task, "id") == -10001);
+
+    ktv_obj_set_byte_h(job, age, 45);
+    ktv_obj_set_int4_h(user, age, 45);
+    print_result("handle mismatch", ktv_obj_get_byte_h(job, age) == 0 && ktv_obj_get_int4_h(user, age) == 0 &&
+                                        ktv_obj_get_byte(user, "age") == 30 &&
+                                        ktv_obj_get_array_h(user, job_field) == NULL);
+
+    ktv_field_handle unknown = ktv_field_resolve(tree, "user", "unknown");
+    print_result("handle unknown", unknown.model_index == 0xFF &&
+                                       ktv_field_resolve(tree, "unknown", "age").model_index == 0xFF &&
+                                       ktv_obj_new_h(tree, ktv_model_resolve(tree, "unknown")) == NULL);
+
+    // job is model 0 in both trees, a handle of one must not reach into the other's objects
+    uint8_t job_proto[] = {1, 3, 'j', 'o', 'b', 1, 1, 'x', KTV_TBYTE, 0};
+    ktv_tree *job_tree = ktv_tree_new(job_proto, sizeof(job_proto));
+    ktv_obj *other_job = ktv_obj_new(job_tree, "job");
+    ktv_obj_set_byte_h(other_job, type, 9);
+    print_result("handle tree", type.model_index == other_job->model_index && ktv_obj_get_byte_h(other_job, type) == 0 &&
+                                    count_set_fields(other_job) == 0 &&
+                                    ktv_obj_new_h(job_tree, ktv_model_resolve(tree, "job")) == NULL);
+    ktv_obj_delete(other_job);
+    ktv_tree_delete(job_tree);
+    ktv_obj_delete(user);
+}
+
+void hash_lookup_test(ktv_tree *tree)
+{
+    printf("\n=== Hash Lookup ===\n");
+    int ok = 1;
+    for (int i = 0; i < tree->model_count; i++)
+    {
+        ok = ok && ktv_model_resolve(tree, tree->models[i]->name).model_index == i;
+    }
+    print_result("model lookup", ok && ktv_model_resolve(tree, "users").model_index == 0xFF);
+
+    // one model with 200 int2 fields f0 .. f199, plus a second model
+    uint8_t proto[2048];
+    size_t size = 0;
+    proto[size++] = 2;
+    proto[size++] = 4;
+    memcpy(proto + size, "wide", 4);
+    size += 4;
+    proto[size++] = 200;
+    for (int i = 0; i < 200; i++)
+    {
+        char alias[8];
+        int length = sprintf(alias, "f%d", i);
+        proto[size++] = length;
+        memcpy(proto + size, alias, length);
+        size += length;
+        proto[size++] = KTV_TINT2;
+        proto[size++] = 0;
+    }
+    proto[size++] = 4;
+    memcpy(proto + size, "tiny", 4);
+    size += 4;
+    proto[size++] = 1;
+    proto[size++] = 1;
+    proto[size++] = 'x';
+    proto[size++] = KTV_TBYTE;
+    proto[size++] = 0;
+
+    ktv_tree *wide_tree = ktv_tree_new(proto, size);
+    ktv_obj *wide = ktv_obj_new(wide_tree, "wide");
+    ok = wide != NULL && ktv_obj_new(wide_tree, "wider") == NULL;
+    for (int i = 0; i < 200 && ok; i++)
+    {
+        char alias[8];
+        sprintf(alias, "f%d", i);
+        ktv_obj_set_int2(wide, alias, i * 3);
+        ok = ktv_obj_field_index(wide, alias) == i && ktv_obj_get_int2(wide, alias) == i * 3;
+    }
+    ktv_obj *tiny = ktv_obj_new(wide_tree, "tiny");
+    ktv_obj_set_int2(tiny, "x", 1);
+    ktv_obj_set_byte(tiny, "x", 2);
+    print_result("alias lookup", ok && ktv_obj_field_index(wide, "f200") == 0xFF &&
+                                     ktv_obj_get_byte(wide, "f1") == 0 && ktv_obj_get_byte(tiny, "x") == 2 &&
+                                     ktv_obj_get_int2(tiny, "x") == 0);
+    ktv_obj_delete(tiny);
+    ktv_obj_delete(wide);
+    ktv_tree_delete(wide_tree);
+}
+
+void *pool_attach_worker(void *argument)
+{
+    void **arguments = (void **)argument;
+    ktv_pool_attach((ktv_pool *)arguments[0]);
+    pthread_barrier_wait((pthread_barrier_t *)arguments[1]);
+    pthread_barrier_wait((pthread_barrier_t *)arguments[1]);
+    ktv_pool_attach(NULL);
+    return NULL;
+}
+
+void pool_test(ktv_tree *tree)
+{
+    printf("\n=== Pool ===\n");
+    ktv_obj *user = new_test_user(tree);
+    ktv_buffer *buffer = ktv_obj_encode(user);
+    ktv_pool *pool = ktv_pool_new(tree, 2);
+    ktv_pool_attach(pool);
+    int ok = ktv_pool_current() == pool;
+    for (int i = 0; i < 3; i++)
+    {
+        ktv_obj *decoded = ktv_obj_new(tree, "user");
+        ktv_obj_decode(decoded, buffer);
+        ktv_buffer *reencoded = ktv_obj_encode(decoded);
+        ok = ok && reencoded->size == buffer->size && memcmp(reencoded->buffer, buffer->buffer, buffer->size) == 0;
+        ktv_buffer_delete(reencoded);
+        ktv_obj_delete(decoded);
+    }
+    // user, job & two task shells plus four array headers per round, only two headers fit in the pool
+    print_result("pool recycle", ok && pool->misses == 8 + 2 + 2 && pool->hits == 6 + 6);
+
+    print_result("pool cap", pool->obj_counts[ktv_model_resolve(tree, "task").model_index] == 2 &&
+                                 pool->obj_counts[ktv_model_resolve(tree, "user").model_index] == 1 &&
+                                 pool->array_count == 2);
+
+    ktv_pool_attach(NULL);
+    ktv_obj *task = ktv_obj_new(tree, "task");
+    ktv_obj_delete(task);
+    print_result("pool detached", ktv_pool_current() == NULL && pool->hits == 12 && pool->misses == 12);
+
+    // a second thread keeps the pool attached until the first delete was refused
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, 2);
+    void *arguments[2] = {pool, &barrier};
+    pthread_t thread;
+    pthread_create(&thread, NULL, pool_attach_worker, arguments);
+    pthread_barrier_wait(&barrier);
+    ktv_pool_attach(pool);
+    int refused = ktv_pool_delete(pool) == -1 && ktv_pool_current() == NULL && pool->attached == 1;
+    pthread_barrier_wait(&barrier);
+    pthread_join(thread, NULL);
+    pthread_barrier_destroy(&barrier);
+    print_result("pool delete attached", refused);
+
+    ktv_pool_attach(pool);
+    int deleted = ktv_pool_delete(pool) == 0;
+    ktv_buffer_delete(buffer);
+    ktv_obj_delete(user);
+    print_result("pool delete", deleted && ktv_pool_current() == NULL);
+}
+
+void sparse_codec_test(ktv_tree *tree)
+{
+    printf("\n=== Sparse Codec ===\n");
+    ktv_obj *user = new_test_user(tree);
+    ktv_buffer *dense = ktv_obj_encode(user);
+    ktv_buffer *sparse = ktv_obj_encode_sparse(user);
+    ktv_obj *decoded = ktv_obj_new(tree, "user");
+    ktv_obj_decode_sparse(decoded, sparse);
+    ktv_buffer *reencoded = ktv_obj_encode(decoded);
+    print_result("sparse round trip", reencoded->size == dense->size &&
+                                          memcmp(reencoded->buffer, dense->buffer, dense->size) == 0);
+    ktv_buffer_delete(reencoded);
+    ktv_obj_delete(decoded);
+
+    // user bitmap, age, gender, job length & job, then tasks count
+    size_t tasks_at = 5 + (sparse->buffer[3] << 8 | sparse->buffer[4]);
+    int ok = ktv_validate_sparse(tree, "user", sparse->buffer, sparse->size) == 0;
+    // every cut is copied to an exact size buffer, so reading past it is caught by sanitizers
+    for (size_t size = 0; size < sparse->size; size++)
+    {
+        ktv_buffer *cut = ktv_buffer_new(sparse->buffer, size);
+        decoded = ktv_obj_new(tree, "user");
+        ktv_obj_decode_sparse(decoded, cut);
+        ktv_array *tasks = ktv_obj_get_array(decoded, "tasks");
+        // count and first element prefix do not fit before tasks_at + 6
+        ok = ok && (size >= tasks_at + 6 || tasks == NULL) && (size < tasks_at + 6 || tasks->count == 2);
+        ktv_validate_sparse(tree, "user", cut->buffer, cut->size);
+        ktv_obj_delete(decoded);
+        ktv_buffer_delete(cut);
+    }
+    print_result("sparse truncated model array", ok &&
+                                                     ktv_validate_sparse(tree, "user", sparse->buffer, tasks_at + 3) == -1 &&
+                                                     ktv_validate_sparse(tree, "user", sparse->buffer, tasks_at + 6) == -1);
+
+    ktv_buffer *hostile = ktv_buffer_new(sparse->buffer, tasks_at + 6);
+    hostile->buffer[tasks_at] = 0xFF;
+    hostile->buffer[tasks_at + 1] = 0xFF;
+    decoded = ktv_obj_new(tree, "user");
+    ktv_obj_decode_sparse(decoded, hostile);
+    print_result("sparse hostile count", ktv_obj_get_array(decoded, "tasks") == NULL &&
+                                             ktv_obj_get_byte(decoded, "age") == 30 &&
+                                             ktv_validate_sparse(tree, "user", hostile->buffer, hostile->size) == -1);
+    ktv_obj_delete(decoded);
+    ktv_buffer_delete(hostile);
+    ktv_buffer_delete(sparse);
+
+    ktv_obj *partial = ktv_obj_new(tree, "user");
+    ktv_obj_set_byte(partial, "gender", 1);
+    ktv_obj *job = ktv_obj_new(tree, "job");
+    ktv_obj_set_byte(job, "type", 2);
+    ktv_obj_set_obj(partial, "job", job);
+    ktv_buffer_delete(dense);
+    dense = ktv_obj_encode(partial);
+    sparse = ktv_obj_encode_sparse(partial);
+    // user bitmap, gender, job length, job bitmap, type
+    uint8_t expected[] = {0x06, 0x01, 0x00, 0x02, 0x02, 0x02};
+    decoded = ktv_obj_new(tree, "user");
+    ktv_obj_decode_sparse(decoded, sparse);
+    print_result("sparse absent fields", sparse->size == sizeof(expected) &&
+                                             memcmp(sparse->buffer, expected, sizeof(expected)) == 0 &&
+                                             ktv_obj_get_byte(decoded, "gender") == 1 &&
+                                             ktv_obj_get_value_by_index(decoded, ktv_obj_field_index(decoded, "age")) == NULL &&
+                                             ktv_obj_get_byte(ktv_obj_get_obj(decoded, "job"), "type") == 2 &&
+                                             ktv_obj_get_array(decoded, "tasks") == NULL);
+    ktv_obj_delete(decoded);
+
+    decoded = ktv_obj_new(tree, "user");
+    sparse->size = 2;
+    ktv_obj_decode_sparse(decoded, sparse);
+    print_result("sparse truncated", ktv_obj_get_byte(decoded, "gender") == 1 && ktv_obj_get_obj(decoded, "job") == NULL);
+    ktv_obj_delete(decoded);
+
+    ktv_buffer_delete(sparse);
+    ktv_buffer_delete(dense);
+    ktv_obj_delete(partial);
+    ktv_obj_delete(user);
+}
+
+void int_array_benchmark_test(ktv_tree *tree, int repeat)
+{
+    printf("\n=== Int Array Benchmark ===\n");
+    clock_t start, stop;
+    size_t count = 4096;
+    ktv_obj *task = new_test_task(tree, count);
+    ktv_buffer *buffer = ktv_buffer_new(NULL, 0);
+    // scalar loop first as the baseline, then the kernels picked for this cpu
+    for (int scalar = 1; scalar >= 0; scalar--)
+    {
+        const char *kernel = scalar ? "scalar" : "simd";
+        ktv_set_scalar_kernels(scalar);
+        start = clock();
+        for (int i = 0; i < repeat; i++)
+        {
+            ktv_buffer_clear(buffer);
+            ktv_obj_encode_append(task, buffer);
+        }
+        stop = clock();
+        double timecost = (double)(stop - start) / CLOCKS_PER_SEC;
+        printf("Encode int4 x %zu (%s) Repeat %d times: %f (s), %f (ns/element)\n",
+               count, kernel, repeat, timecost, timecost * 1e9 / repeat / count);
+
+        start = clock();
+        for (int i = 0; i < repeat; i++)
+        {
+            ktv_obj *decoded = ktv_obj_new(tree, "task");
+            ktv_obj_decode(decoded, buffer);
+            ktv_obj_delete(decoded);
+        }
+        stop = clock();
+        timecost = (double)(stop - start) / CLOCKS_PER_SEC;
+        printf("Decode int4 x %zu (%s) Repeat %d times: %f (s), %f (ns/element)\n",
+               count, kernel, repeat, timecost, timecost * 1e9 / repeat / count);
+    }
+    ktv_set_scalar_kernels(0);
+    ktv_buffer_delete(buffer);
+    ktv_obj_delete(task);
+}
+
+void parallel_benchmark_test(ktv_tree *tree, int repeat)
+{
+    struct timespec start, stop;
+    ktv_obj *address_book = new_test_large_address_book(tree, 60000);
+    for (size_t threads = 1; threads <= 16; threads *= 2)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < repeat; i++)
+        {
+            ktv_buffer_delete(ktv_obj_encode_parallel(address_book, thread_executor, &threads));
+        }
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        double timecost = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Parallel Encode (%zu threads) Repeat %d times: %f (s)\n", threads, repeat, timecost);
+    }
+    ktv_buffer *buffer = ktv_obj_encode(address_book);
+    for (size_t threads = 1; threads <= 16; threads *= 2)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < repeat; i++)
+        {
+            ktv_obj *decoded = ktv_obj_new(tree, "AddressBook");
+            ktv_obj_decode_parallel(decoded, buffer, thread_executor, &threads);
+            ktv_obj_delete(decoded);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        double timecost = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Parallel Decode (%zu threads) Repeat %d times: %f (s)\n", threads, repeat, timecost);
+    }
+    ktv_buffer_delete(buffer);
+    ktv_obj_delete(address_book);
+}
+
+void benchmark_test(ktv_tree *tree, int repeat)
+{
+    clock_t start, stop;
+
+    ktv_obj *address_book = new_test_address_book(tree);
     start = clock();
     for (size_t i = 0; i < repeat; i++)
     {
@@ -117,10 +1100,49 @@ void benchmark_test(ktv_tree *tree, int repeat)
         ktv_obj_delete(decoded);
     }
     stop = clock();
-    ktv_buffer_delete(buffer);
     timecost = (double)(stop - start) / CLOCKS_PER_SEC;
     printf("Decode Repeat %d times: %f (s)\n", repeat, timecost);
 
+    ktv_obj *decoded = ktv_obj_new(tree, "AddressBook");
+    start = clock();
+    for (size_t i = 0; i < repeat; i++)
+    {
+        ktv_obj_reset(decoded);
+        ktv_obj_decode(decoded, buffer);
+    }
+    stop = clock();
+    ktv_obj_delete(decoded);
+    timecost = (double)(stop - start) / CLOCKS_PER_SEC;
+    printf("Decode Reuse Repeat %d times: %f (s)\n", repeat, timecost);
+
+    ktv_arena *arena = ktv_arena_new(0);
+    start = clock();
+    for (size_t i = 0; i < repeat; i++)
+    {
+        ktv_obj *decoded = ktv_obj_new_in(arena, tree, "AddressBook");
+        ktv_obj_decode(decoded, buffer);
+        ktv_arena_reset(arena);
+    }
+    stop = clock();
+    ktv_arena_delete(arena);
+    timecost = (double)(stop - start) / CLOCKS_PER_SEC;
+    printf("Decode Arena Repeat %d times: %f (s)\n", repeat, timecost);
+
+    ktv_pool *pool = ktv_pool_new(tree, 0);
+    ktv_pool_attach(pool);
+    start = clock();
+    for (size_t i = 0; i < repeat; i++)
+    {
+        ktv_obj *decoded = ktv_obj_new(tree, "AddressBook");
+        ktv_obj_decode(decoded, buffer);
+        ktv_obj_delete(decoded);
+    }
+    stop = clock();
+    ktv_pool_delete(pool);
+    ktv_buffer_delete(buffer);
+    timecost = (double)(stop - start) / CLOCKS_PER_SEC;
+    printf("Decode Pool Repeat %d times: %f (s)\n", repeat, timecost);
+
     ktv_obj_delete(address_book);
 }
 
@@ -143,7 +1165,30 @@ int main(int argc, char const *argv[])
     ktv_print_tree(tree);
 
     codec_test_with_output(tree);
+    encode_into_test(tree);
+    buffer_reuse_test(tree);
+    encode_iov_test(tree);
+    encode_stream_test(tree);
+    int_array_codec_test(tree);
+    truncated_decode_test(tree);
+    encode_batch_test(tree);
+    encode_parallel_test(tree);
+    decode_parallel_test(tree);
+    view_test(tree);
+    set_by_index_test(tree);
+    validate_test(tree);
+    decode_fields_test(tree);
+    array_index_test(tree);
+    push_decoder_test(tree);
+    decode_reuse_test(tree);
+    arena_test(tree);
+    field_handle_test(tree);
+    hash_lookup_test(tree);
+    pool_test(tree);
+    sparse_codec_test(tree);
     // benchmark_test(tree, 1000000);
+    int_array_benchmark_test(tree, 1000);
+    // parallel_benchmark_test(tree, 100);
 
     ktv_tree_delete(tree);
     return 0;
@@ -0,0 +1,53 @@
+#ifndef KTV_TEST_COMMON_H
+#define KTV_TEST_COMMON_H
+
+#include <stdio.h>
+#include <string.h>
+#include "ktv.h"
+
+// fixtures shared by the test programs
+
+static inline void print_result(const char *name, int ok)
+{
+    printf("%s: %s\n", name, ok ? "OK" : "FAILED");
+}
+
+/**
+ * user with job, two tasks & name, no mentor
+ */
+static inline ktv_obj *new_test_user(ktv_tree *tree)
+{
+    ktv_obj *user = ktv_obj_new(tree, "user");
+    ktv_obj_set_byte(user, "age", 30);
+    ktv_obj_set_byte(user, "gender", 1);
+
+    ktv_obj *job = ktv_obj_new(tree, "job");
+    char *title = "Product Manager";
+    ktv_array *title_array = ktv_array_new_string(job, "title", title, strlen(title));
+    ktv_obj_set_array(job, "title", title_array);
+    ktv_obj_set_byte(job, "type", 2);
+
+    ktv_obj_set_obj(user, "job", job);
+
+    ktv_obj *task1 = ktv_obj_new(tree, "task");
+    ktv_obj_set_int2(task1, "id", 10001);
+    ktv_obj_set_byte(task1, "status", 3);
+    ktv_obj *task2 = ktv_obj_new(tree, "task");
+    ktv_obj_set_int2(task2, "id", -10002);
+    ktv_obj_set_byte(task2, "status", 2);
+    int32_t task2_times[2] = {1234567, -7654321};
+    ktv_array *task2_time_array = ktv_array_new_int4s(task2, "time", task2_times, 2);
+    ktv_obj_set_array(task2, "time", task2_time_array);
+    ktv_array *task_array = ktv_array_new_objs(user, "tasks", 2);
+    ktv_array_set_obj(task_array, 0, task1);
+    ktv_array_set_obj(task_array, 1, task2);
+
+    ktv_obj_set_array(user, "tasks", task_array);
+
+    char *name = "Zhang Ji";
+    ktv_array *name_array = ktv_array_new_string(user, "name", name, strlen(name));
+    ktv_obj_set_array(user, "name", name_array);
+    return user;
+}
+
+#endif